@@ -0,0 +1,171 @@
+#include "arena.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+  ARENA_ALIGNMENT = sizeof(void *)
+};
+
+struct arena_chunk
+{
+  struct arena_chunk *next;
+  size_t capacity;
+  size_t used;
+  char data[];
+};
+
+static struct arena_chunk *arena_alloc_chunk(size_t capacity);
+static size_t arena_align(size_t size);
+
+
+/* Allocates a chunk able to hold 'capacity' bytes */
+
+static struct arena_chunk *arena_alloc_chunk(size_t capacity)
+{
+  struct arena_chunk *chunk = malloc(sizeof(struct arena_chunk) + capacity);
+  if (chunk == NULL)
+  {
+    perror("arena_alloc_chunk");
+    exit(EXIT_FAILURE);
+  }
+
+  chunk->next = NULL;
+  chunk->capacity = capacity;
+  chunk->used = 0;
+  return chunk;
+}
+
+
+/* Rounds size up to the arena's alignment */
+
+static size_t arena_align(size_t size)
+{
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+
+/* Initialises an arena with a first chunk of 'capacity' bytes */
+
+void arena_init(struct arena *a, size_t capacity)
+{
+  assert(a != NULL);
+  assert(capacity > 0);
+
+  a->chunks = arena_alloc_chunk(arena_align(capacity));
+  a->last = NULL;
+}
+
+
+/* Returns 'size' bytes of memory that stay valid until the arena is
+ * reset or destroyed. Never returns NULL.
+ */
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+  assert(a != NULL);
+
+  struct arena_chunk *chunk = a->chunks;
+  const size_t start = arena_align(chunk->used);
+
+  if (start + size > chunk->capacity)
+  {
+    size_t capacity = 2 * chunk->capacity;
+    while (capacity < size)
+      capacity *= 2;
+
+    chunk = arena_alloc_chunk(capacity);
+    chunk->next = a->chunks;
+    a->chunks = chunk;
+  }
+
+  char *result = chunk->data + arena_align(chunk->used);
+  chunk->used = result - chunk->data + size;
+  a->last = result;
+
+  return result;
+}
+
+
+/* Given a string, return a copy allocated in the arena */
+
+char *arena_clone(struct arena *a, const char *str)
+{
+  const size_t length = strlen(str) + 1;
+  char *copy = arena_alloc(a, length);
+  memcpy(copy, str, length);
+  return copy;
+}
+
+
+/* Returns "current" with "append" appended. If current was the most
+ * recent allocation from the arena it is extended in place, so building
+ * a string piece by piece costs no more than its final size.
+ */
+
+char *arena_append(struct arena *a, char *current, const char *append)
+{
+  assert(a != NULL);
+  assert(current != NULL);
+  assert(append != NULL);
+
+  const size_t current_length = strlen(current);
+  const size_t append_length = strlen(append);
+  struct arena_chunk *chunk = a->chunks;
+
+  if (current == a->last
+      && current + current_length + append_length + 1 <= chunk->data + chunk->capacity)
+  {
+    memcpy(current + current_length, append, append_length + 1);
+    chunk->used = current - chunk->data + current_length + append_length + 1;
+    return current;
+  }
+
+  char *result = arena_alloc(a, current_length + append_length + 1);
+  memcpy(result, current, current_length);
+  memcpy(result + current_length, append, append_length + 1);
+  return result;
+}
+
+
+/* Releases everything allocated from the arena. If the allocations
+ * spilled over into more than one chunk, the chunks are replaced with a
+ * single one large enough to hold all of them next time.
+ */
+
+void arena_reset(struct arena *a)
+{
+  assert(a != NULL);
+
+  if (a->chunks->next != NULL)
+  {
+    size_t capacity = 0;
+    while (a->chunks != NULL)
+    {
+      struct arena_chunk *next = a->chunks->next;
+      capacity += a->chunks->capacity;
+      free(a->chunks);
+      a->chunks = next;
+    }
+
+    a->chunks = arena_alloc_chunk(capacity);
+  }
+
+  a->chunks->used = 0;
+  a->last = NULL;
+}
+
+
+/* Deallocates memory held by the arena */
+
+void arena_destroy(struct arena *a)
+{
+  while (a->chunks != NULL)
+  {
+    struct arena_chunk *next = a->chunks->next;
+    free(a->chunks);
+    a->chunks = next;
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct arena_chunk;
+
+/* A bump-pointer allocator. Memory is handed out from a chain of chunks
+ * and is only ever released all at once by arena_reset(), which also
+ * merges the chain into a single chunk big enough for everything that
+ * was allocated. Work that repeats with a similar footprint (an ELIZA
+ * turn) therefore stops touching the heap after its first few rounds.
+ */
+
+struct arena
+{
+  struct arena_chunk *chunks;
+  char *last;
+};
+
+void arena_init(struct arena *a, size_t capacity);
+void *arena_alloc(struct arena *a, size_t size);
+char *arena_clone(struct arena *a, const char *str);
+char *arena_append(struct arena *a, char *current, const char *append);
+void arena_reset(struct arena *a);
+void arena_destroy(struct arena *a);
+
+#endif
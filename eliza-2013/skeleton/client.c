@@ -0,0 +1,116 @@
+#include "client.h"
+#include "session.h"
+#include "string_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int client_connect(const char *socket_path);
+static int client_print_reply(FILE *from_server);
+
+
+/* Connects to the server listening on socket_path. Returns the socket,
+ * or -1 on failure.
+ */
+
+static int client_connect(const char *socket_path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (strlen(socket_path) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "Socket path too long: %s\n", socket_path);
+    return -1;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    perror("socket");
+    return -1;
+  }
+
+  if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0)
+  {
+    perror("connect");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+/* Reads one reply line from the server and prints it as ELIZA. Returns
+ * 0 on success or -1 once the server has hung up.
+ */
+
+static int client_print_reply(FILE *from_server)
+{
+  char buffer[MAX_INPUT_LENGTH];
+
+  if (fgets(buffer, sizeof(buffer), from_server) == NULL)
+    return -1;
+
+  trim_newline(buffer);
+  printf("ELIZA> %s\n", buffer);
+  return 0;
+}
+
+
+/* Holds a conversation between stdin/stdout and the ELIZA server
+ * listening on socket_path, presenting it like the interactive mode.
+ * Returns 0 when either side ends the session.
+ */
+
+int client_run(const char *socket_path)
+{
+  assert(socket_path != NULL);
+
+  const int fd = client_connect(socket_path);
+  if (fd < 0)
+    return -1;
+
+  FILE *from_server = fdopen(fd, "r");
+  if (from_server == NULL)
+  {
+    perror("fdopen");
+    close(fd);
+    return -1;
+  }
+
+  char buffer[MAX_INPUT_LENGTH];
+  int result = client_print_reply(from_server);
+
+  while (result == 0)
+  {
+    printf("USER> ");
+    fflush(stdout);
+
+    if (fgets(buffer, sizeof(buffer), stdin) == NULL)
+      break;
+
+    trim_newline(buffer);
+    const size_t length = strlen(buffer);
+    buffer[length] = '\n';
+
+    if (send(fd, buffer, length + 1, MSG_NOSIGNAL) != (ssize_t) (length + 1))
+    {
+      perror("send");
+      break;
+    }
+
+    result = client_print_reply(from_server);
+  }
+
+  fflush(stdout);
+  fclose(from_server);
+  return 0;
+}
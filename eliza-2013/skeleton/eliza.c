@@ -4,71 +4,17 @@
 #include "map.h"
 #include "eliza_state.h"
 #include "rule.h"
+#include "session.h"
+#include "server.h"
+#include "client.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "reload.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
-
-static const char *no_match_key = "xnone";
-
-enum
-{
-  MAX_INPUT_LENGTH = 256
-};
-
-
-/*
- * Tokenizes input string const_input, replacing words using the
- * synonyms in eliza. If succesful *buffer is assigned an array of
- * pointers to each token. The return value is the number of tokens.
- * Both the buffer, and the memory for each token need to be called with
- * free() after use.
- *
- */
-
-static int tokenize_and_rewrite(struct eliza_state *eliza, const char* const_input, char ***output)
-{
-  assert(eliza != NULL);
-  assert(const_input != NULL);
-  assert(output != NULL);
-
-  char *const input = clone(const_input);
-  char **tokens;
-
-  const int token_count = tokenize(&tokens, input);
-  for(int index = 0; index < token_count; ++index)
-  {
-    make_lowercase(tokens[index]);
-    
-    char *replacement = (char *) map_lookup(&eliza->synonyms, tokens[index]);
-
-    if (replacement == NULL)
-      tokens[index] = clone(tokens[index]);
-    else
-      tokens[index] = clone(replacement);
-  }
-
-  free(input);
-  *output = tokens;
-  return token_count;
-}
-
-
-/*
- * Frees token list allocated with tokenize_and_rewrite().
- *
- */
-
-static void free_rewritten(char **tokens, const int count)
-{
-  assert(tokens != NULL);
-
-  for(int i = 0; i < count; ++i)
-    free(tokens[i]);
-
-  free(tokens);
-}
-
+#include <unistd.h>
 
 /*
  * Prompt for user if user==1 else prompt for ELIZA.
@@ -86,26 +32,6 @@ static void prompt(int user)
 }
 
 
-/* Returns true if the string is a token suggesting the user wants to
- * exit the session.
- *
- */
-
-static int is_exit(struct eliza_state *eliza, const char *str)
-{
-  assert(eliza != NULL);
-  assert(str != NULL);
-
-  char* lowercase = clone(str);
-  make_lowercase(lowercase);
-
-  const int result = map_contains(&eliza->quit_words, lowercase);
-  free(lowercase);
-
-  return result;
-}
-
-
 /* Start the conversation with the user */
 
 static void begin(struct eliza_state *eliza)
@@ -133,6 +59,9 @@ static void depart(struct eliza_state *eliza)
 
 static void interactive_loop(struct eliza_state *eliza)
 {
+  struct eliza_session session;
+  session_init(&session, 1);
+
   begin(eliza);
 
   char buffer[MAX_INPUT_LENGTH];
@@ -140,59 +69,147 @@ static void interactive_loop(struct eliza_state *eliza)
   {
     trim_newline(buffer);
 
-    if (is_exit(eliza, buffer))
+    char *out;
+    const int result = session_respond(&session, eliza, buffer, NULL, &out);
+
+    if (result == SESSION_QUIT)
     {
       depart(eliza);
       break;
     }
 
-    char *input = rewrite_string(&eliza->prereplace, buffer);
-    char **tokens;
-    const int token_count = tokenize_and_rewrite(eliza, input, &tokens);
-
-    struct list applicable_rules;
-    list_init(&applicable_rules);
-    for(int token_index = 0; token_index < token_count; ++token_index)
-      find_rules(eliza, tokens[token_index], input, &applicable_rules);
-
-    if (list_empty(&applicable_rules))
-      find_rules(eliza, no_match_key, input, &applicable_rules);
-
-    if (!list_empty(&applicable_rules))
+    if (result == SESSION_REPLY)
     {
-      struct rule *rule = choose_rule(&applicable_rules);
-      char *out;
-      if (rule_apply(eliza, rule, input, &out) == 0)
-      {
-        prompt(0);
-        printf("%s\n", out);
-        free(out);
-        fflush(stdout);
-      }
+      prompt(0);
+      printf("%s\n", out);
+      fflush(stdout);
     }
-    else
+    else if (result == SESSION_NO_RULE)
     {
       printf("<failed to find *any* usable rule>");
     }
 
-    list_destroy(&applicable_rules);
-    free_rewritten(tokens, token_count);
-    free(input);
     prompt(1);
   }
+
+  session_destroy(&session);
+}
+
+
+/* Prints command line usage */
+
+static void usage(const char *program)
+{
+  fprintf(stderr, "Usage: %s [-l snapshot | -w snapshot] [-s socket [-t threads] | -c socket\n", program);
+  fprintf(stderr, "       | -r corpus [-n iterations] [-o results.json]]\n");
+  fprintf(stderr, "  -l snapshot load a compiled snapshot instead of parsing the script\n");
+  fprintf(stderr, "  -w snapshot compile the script into a snapshot and exit\n");
+  fprintf(stderr, "  -s socket   serve concurrent sessions on a Unix domain socket;\n");
+  fprintf(stderr, "              SIGHUP reloads the script (or snapshot)\n");
+  fprintf(stderr, "  -t threads  number of server worker threads (default %d)\n", DEFAULT_WORKER_COUNT);
+  fprintf(stderr, "  -c socket   talk to a running server instead of loading the script\n");
+  fprintf(stderr, "  -r corpus   replay each line of corpus and report per-phase latency\n");
+  fprintf(stderr, "  -n count    number of times to replay the corpus (default 1)\n");
+  fprintf(stderr, "  -o file     write replay results as JSON to file (default stdout)\n");
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
-  struct eliza_state eliza;
-  eliza_init(&eliza);
-  const int result = parse_eliza_script(&eliza, "./script");
+  const char *server_path = NULL;
+  const char *client_path = NULL;
+  const char *load_path = NULL;
+  const char *save_path = NULL;
+  const char *corpus_path = NULL;
+  const char *json_path = NULL;
+  int worker_count = DEFAULT_WORKER_COUNT;
+  int iterations = 1;
+
+  int option;
+  while ((option = getopt(argc, argv, "s:t:c:l:w:r:n:o:")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        server_path = optarg;
+        break;
+
+      case 't':
+        worker_count = atoi(optarg);
+        break;
+
+      case 'c':
+        client_path = optarg;
+        break;
+
+      case 'l':
+        load_path = optarg;
+        break;
 
-  if (result != 0)
-    fprintf(stderr, "Unable to load rules from file.");
+      case 'w':
+        save_path = optarg;
+        break;
+
+      case 'r':
+        corpus_path = optarg;
+        break;
+
+      case 'n':
+        iterations = atoi(optarg);
+        break;
+
+      case 'o':
+        json_path = optarg;
+        break;
+
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  const int modes = (server_path != NULL) + (client_path != NULL) + (corpus_path != NULL);
+  if (optind != argc || worker_count <= 0 || iterations <= 0 || modes > 1
+      || (load_path != NULL && save_path != NULL))
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (client_path != NULL)
+    return client_run(client_path) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  struct reloadable_eliza reloadable;
+  if (reload_init(&reloadable, "./script", load_path) != 0)
+  {
+    fprintf(stderr, "Unable to load rules from file.\n");
+    return EXIT_FAILURE;
+  }
+
+  struct eliza_state *eliza = reload_acquire(&reloadable);
+
+  int status = EXIT_SUCCESS;
+  if (save_path != NULL)
+  {
+    if (snapshot_save(eliza, save_path) != 0)
+      status = EXIT_FAILURE;
+  }
+  else if (corpus_path != NULL)
+  {
+    if (replay_run(eliza, corpus_path, iterations, json_path) != 0)
+      status = EXIT_FAILURE;
+  }
+  else if (server_path != NULL)
+  {
+    if (server_run(&reloadable, server_path, worker_count) != 0)
+      status = EXIT_FAILURE;
+  }
+  else
+  {
+    interactive_loop(eliza);
+  }
 
-  interactive_loop(&eliza);
-  eliza_destroy(&eliza);
+  reload_release(eliza);
+  reload_destroy(&reloadable);
 
-  return EXIT_SUCCESS;
+  return status;
 }
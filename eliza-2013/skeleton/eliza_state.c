@@ -7,8 +7,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <sys/mman.h>
 
 static void destroy_void_ptr_rule(void *vrule);
+static void destroy_void_ptr_list(void *vlist);
 
 /* A wrapper function that calls destroy_rule() but takes a void* so it
  * can be called via a generic function pointer.
@@ -21,6 +23,18 @@ void destroy_void_ptr_rule(void *vrule)
   destroy_rule(rule);
 }
 
+/* A wrapper function that destroys and frees a heap allocated list
+ * but takes a void* so it can be called via a generic function pointer.
+ *
+ */
+
+void destroy_void_ptr_list(void *vlist)
+{
+  struct list *list = (struct list*) vlist;
+  list_destroy(list);
+  free(list);
+}
+
 /* Intialises the ELIZA state structure */
 
 void eliza_init(struct eliza_state *e)
@@ -34,12 +48,82 @@ void eliza_init(struct eliza_state *e)
   map_init(&e->prereplace);
   map_init(&e->postreplace);
   map_init(&e->synonyms);
+  map_init(&e->keywords);
+  e->rule_count = 0;
+  e->patterns = NULL;
+  memset(&e->scanner, 0, sizeof(e->scanner));
+  e->snapshot = NULL;
+  e->snapshot_length = 0;
+}
+
+/* Adds a rule to the ELIZA state, which takes ownership of it */
+
+void eliza_add_rule(struct eliza_state *e, struct rule *rule)
+{
+  assert(e != NULL);
+  assert(rule != NULL);
+
+  rule_prepare(rule);
+  rule->id = e->rule_count++;
+  list_insert_front(&e->rules, rule);
+
+  struct list *keyword_rules = (struct list*) map_lookup(&e->keywords, rule->key);
+  if (keyword_rules == NULL)
+  {
+    keyword_rules = malloc(sizeof(struct list));
+    if (keyword_rules == NULL)
+    {
+      perror("eliza_add_rule");
+      exit(EXIT_FAILURE);
+    }
+
+    list_init(keyword_rules);
+    map_insert(&e->keywords, rule->key, keyword_rules);
+  }
+
+  list_insert_front(keyword_rules, rule);
+}
+
+/* Builds the parts of the state that are derived from the rules: the
+ * compiled decomp patterns and the keyword scanner. Must be called once
+ * all rules have been added and before any input is processed.
+ */
+
+void eliza_prepare(struct eliza_state *e)
+{
+  assert(e != NULL);
+
+  rule_compile_patterns(e);
+  scanner_init(&e->scanner);
+
+  for(list_iter rule_iter = list_begin(&e->rules);
+      rule_iter != list_end(&e->rules);
+      rule_iter = list_iter_next(rule_iter))
+  {
+    struct rule *rule = (struct rule*) list_iter_value(rule_iter);
+    struct list *keyword_rules = (struct list*) map_lookup(&e->keywords, rule->key);
+
+    /* Only the rule at the front of each key's list adds the key */
+    if (list_iter_value(list_begin(keyword_rules)) == rule)
+      scanner_add(&e->scanner, rule->key, keyword_rules);
+  }
+
+  scanner_build(&e->scanner);
 }
 
 /* Frees memory held by the ELIZA state structure */
 
 void eliza_destroy(struct eliza_state *e)
 {
+  rule_free_patterns(e);
+  scanner_destroy(&e->scanner);
+
+  if (e->snapshot != NULL)
+  {
+    munmap(e->snapshot, e->snapshot_length);
+    return;
+  }
+
   free(e->begin);
   free(e->end);
 
@@ -57,4 +141,7 @@ void eliza_destroy(struct eliza_state *e)
 
   map_apply_elems(&e->synonyms, &free);
   map_destroy(&e->synonyms);
+
+  map_apply_elems(&e->keywords, &destroy_void_ptr_list);
+  map_destroy(&e->keywords);
 }
@@ -3,6 +3,21 @@
 
 #include "list.h"
 #include "map.h"
+#include "scanner.h"
+#include <stddef.h>
+
+struct rule;
+struct rule_pattern;
+
+/* The keywords map indexes rules by key: each value is a heap allocated
+ * struct list of the rules in 'rules' with that key. Rules are numbered
+ * 0..rule_count-1 and patterns[rule->id] is the rule's compiled decomp
+ * pattern. The scanner finds the keys of the rules in a line of input;
+ * the value reported with each hit is the key's list in 'keywords'.
+ * Both are built by eliza_prepare(). If the state was loaded from a
+ * snapshot, everything except the struct itself and the compiled
+ * patterns lives in the read-only mapping 'snapshot'.
+ */
 
 struct eliza_state
 {
@@ -13,9 +28,17 @@ struct eliza_state
   struct map postreplace;
   struct map synonyms;
   struct list rules;
+  struct map keywords;
+  size_t rule_count;
+  struct rule_pattern *patterns;
+  struct keyword_scanner scanner;
+  void *snapshot;
+  size_t snapshot_length;
 };
 
 void eliza_init(struct eliza_state *e);
+void eliza_add_rule(struct eliza_state *e, struct rule *rule);
+void eliza_prepare(struct eliza_state *e);
 void eliza_destroy(struct eliza_state *e);
 void eliza_print_rules(struct eliza_state *e);
 
@@ -1,4 +1,5 @@
 #include "list.h"
+#include "arena.h"
 #include <stdlib.h>
 #include <stddef.h>
 #include <assert.h>
@@ -11,14 +12,17 @@ struct list_elem
   struct list_elem *next;
 };
 
-static struct list_elem *list_alloc_elem(void);
+static struct list_elem *list_alloc_elem(struct list *l);
 static void list_free_elem(struct list_elem *elem);
 static int list_is_internal(list_iter iter);
 
 /* Allocates a list node */
 
-struct list_elem *list_alloc_elem(void)
+struct list_elem *list_alloc_elem(struct list *l)
 {
+  if (l->arena != NULL)
+    return arena_alloc(l->arena, sizeof(struct list_elem));
+
   struct list_elem *elem = malloc(sizeof(struct list_elem));
   if (elem == NULL)
   {
@@ -50,8 +54,17 @@ static int list_is_internal(list_iter iter)
 
 void list_init(struct list *l)
 {
-  l->header = list_alloc_elem();
-  l->footer = list_alloc_elem();
+  list_init_arena(l, NULL);
+}
+
+
+/* Initialises a list struct whose nodes are allocated from 'arena' */
+
+void list_init_arena(struct list *l, struct arena *arena)
+{
+  l->arena = arena;
+  l->header = list_alloc_elem(l);
+  l->footer = list_alloc_elem(l);
   l->header->prev = NULL;
   l->footer->next = NULL;
   l->header->next = l->footer;
@@ -63,7 +76,7 @@ void list_init(struct list *l)
 
 void list_insert(struct list *l, list_iter iter, void *value)
 {
-  struct list_elem *new_elem = list_alloc_elem();
+  struct list_elem *new_elem = list_alloc_elem(l);
   new_elem->value = value;
 
   new_elem->prev = iter->prev;
@@ -171,6 +184,9 @@ void *list_get_elem(struct list *l, const size_t index)
 
 void list_destroy(struct list *l)
 {
+  if (l->arena != NULL)
+    return;
+
   struct list_elem *elem = l->header;
   while (elem != NULL)
   {
@@ -192,3 +208,32 @@ void list_apply_elems(struct list *l, void (*function)(void*))
       function(list_iter_value(iter));
   }
 }
+
+
+/* Writes the list into a snapshot. The struct list itself has already
+ * been reserved at offset 'at'; values are written with write_value.
+ */
+
+void list_snapshot(struct list *l, struct snapshot_writer *w, size_t at, snapshot_value_writer write_value)
+{
+  size_t previous = snapshot_reserve(w, sizeof(struct list_elem));
+  snapshot_set_pointer(w, at + offsetof(struct list, header), previous);
+
+  for(list_iter iter = list_begin(l);
+      iter != list_end(l);
+      iter = list_iter_next(iter))
+  {
+    const size_t value = write_value(w, list_iter_value(iter));
+    const size_t elem = snapshot_reserve(w, sizeof(struct list_elem));
+
+    snapshot_set_pointer(w, elem + offsetof(struct list_elem, value), value);
+    snapshot_set_pointer(w, elem + offsetof(struct list_elem, prev), previous);
+    snapshot_set_pointer(w, previous + offsetof(struct list_elem, next), elem);
+    previous = elem;
+  }
+
+  const size_t footer = snapshot_reserve(w, sizeof(struct list_elem));
+  snapshot_set_pointer(w, footer + offsetof(struct list_elem, prev), previous);
+  snapshot_set_pointer(w, previous + offsetof(struct list_elem, next), footer);
+  snapshot_set_pointer(w, at + offsetof(struct list, footer), footer);
+}
@@ -1,18 +1,26 @@
 #ifndef LIST_H
 #define LIST_H
 
+#include "snapshot.h"
 #include <stddef.h>
 
 struct list_elem;
+struct arena;
 typedef struct list_elem *list_iter;
 
+/* If arena is non-NULL the list's nodes are allocated from it and are
+ * reclaimed by resetting the arena rather than by list_destroy().
+ */
+
 struct list
 {
   struct list_elem *header;
   struct list_elem *footer;
+  struct arena *arena;
 };
 
 void list_init(struct list *l);
+void list_init_arena(struct list *l, struct arena *arena);
 void list_insert(struct list *l, list_iter iter, void *value);
 void list_insert_front(struct list *l, void *value);
 void list_insert_back(struct list *l, void *);
@@ -26,5 +34,6 @@ size_t list_size(struct list *l);
 void *list_get_elem(struct list *l, size_t index);
 void list_apply_elems(struct list *l, void (*function)(void*));
 void list_destroy(struct list *l);
+void list_snapshot(struct list *l, struct snapshot_writer *w, size_t at, snapshot_value_writer write_value);
 
 #endif
@@ -22,6 +22,7 @@ static int map_contains_internal(struct map_node *node, const char *key);
 static void *map_lookup_internal(struct map_node *node, const char *key);
 static void map_destroy_internal(struct map_node *node);
 static void map_apply_elems_internal(struct map_node *node, void (*function)(void *));
+static size_t map_snapshot_internal(struct map_node *node, struct snapshot_writer *w, snapshot_value_writer write_value);
 
 
 /* Recursive Helper method that inserts the mapping from key to value
@@ -210,3 +211,32 @@ void map_destroy(struct map* m)
 {
   map_destroy_internal(m->root);
 }
+
+
+/* Recursive helper method that writes the subtree node into a snapshot
+ * and returns the offset of its root, or 0 for an empty subtree.
+ */
+
+size_t map_snapshot_internal(struct map_node *node, struct snapshot_writer *w, snapshot_value_writer write_value)
+{
+  if (node == NULL)
+    return 0;
+
+  const size_t at = snapshot_reserve(w, sizeof(struct map_node));
+  snapshot_set_pointer(w, at + offsetof(struct map_node, key), snapshot_write_string(w, node->key));
+  snapshot_set_pointer(w, at + offsetof(struct map_node, value), write_value(w, node->value));
+  snapshot_set_pointer(w, at + offsetof(struct map_node, left), map_snapshot_internal(node->left, w, write_value));
+  snapshot_set_pointer(w, at + offsetof(struct map_node, right), map_snapshot_internal(node->right, w, write_value));
+
+  return at;
+}
+
+
+/* Writes the map into a snapshot. The struct map itself has already
+ * been reserved at offset 'at'; values are written with write_value.
+ */
+
+void map_snapshot(struct map *m, struct snapshot_writer *w, size_t at, snapshot_value_writer write_value)
+{
+  snapshot_set_pointer(w, at + offsetof(struct map, root), map_snapshot_internal(m->root, w, write_value));
+}
@@ -1,6 +1,9 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include "snapshot.h"
+#include <stddef.h>
+
 struct map_node;
 struct map
 {
@@ -13,5 +16,6 @@ int map_contains(struct map* m, const char *key);
 void *map_lookup(struct map *m, const char *key);
 void map_apply_elems(struct map *m, void (*function)(void *));
 void map_destroy(struct map *m);
+void map_snapshot(struct map *m, struct snapshot_writer *w, size_t at, snapshot_value_writer write_value);
 
 #endif
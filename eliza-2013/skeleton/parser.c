@@ -12,7 +12,8 @@
 #define MAX_LINE_LENGTH 512
 
 /* Parses the script file at location 'path' into the specified ELIZA
- * state structure.
+ * state structure. Returns 0 on success, or -1 if the file cannot be
+ * opened.
  */
 
 int parse_eliza_script(struct eliza_state *eliza, const char *path)
@@ -27,7 +28,7 @@ int parse_eliza_script(struct eliza_state *eliza, const char *path)
   if (file == NULL)
   {
     perror("parse_eliza_script");
-    exit(EXIT_FAILURE);
+    return -1;
   }
 
   char *key = NULL;
@@ -139,24 +140,29 @@ int parse_eliza_script(struct eliza_state *eliza, const char *path)
     }
     else if (strcmp(prefix, "key") == 0)
     {
-      char *save_ptr_2;
-      char *key_str = strtok_r(value, " ", &save_ptr_2);
-
-      if (key_str == NULL)
-        continue;
-
-      char *priority_str = strtok_r(NULL, " ", &save_ptr_2);
+      /* The last word is the priority, the words before it the key */
+      char **tokens;
+      const int count = tokenize(&tokens, value);
 
-      if (priority_str == NULL)
+      if (count < 2)
+      {
+        free(tokens);
         continue;
+      }
 
       free(decomp);
       decomp = NULL;
 
       free(key);
-      key = clone(key_str);
+      key = clone(tokens[0]);
+      for(int index = 1; index + 1 < count; ++index)
+      {
+        key = push_string(key, " ");
+        key = push_string(key, tokens[index]);
+      }
 
-      priority = atoi(priority_str);
+      priority = atoi(tokens[count - 1]);
+      free(tokens);
     }
     else if (strcmp(prefix, "decomp") == 0)
     {
@@ -183,7 +189,7 @@ int parse_eliza_script(struct eliza_state *eliza, const char *path)
       rule->decomp = clone(decomp);
       rule->reasmb = clone(value);
       rule->precedence = priority;
-      list_insert_front(&eliza->rules, rule);
+      eliza_add_rule(eliza, rule);
     }
   }
 
@@ -191,6 +197,8 @@ int parse_eliza_script(struct eliza_state *eliza, const char *path)
   free(key);
   fclose(file);
 
+  eliza_prepare(eliza);
+
   return 0;
 }
 
@@ -0,0 +1,53 @@
+#include "profile.h"
+#include <assert.h>
+#include <stddef.h>
+#include <time.h>
+
+const char *const phase_names[PHASE_COUNT] =
+{
+  "prereplace",
+  "tokenize",
+  "find_rules",
+  "choose_rule",
+  "rule_apply",
+  "postreplace"
+};
+
+
+/* Returns a monotonic timestamp in nanoseconds */
+
+long long profile_clock(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/* Zeroes every phase of the profile */
+
+void profile_reset(struct turn_profile *profile)
+{
+  assert(profile != NULL);
+
+  for(int phase = 0; phase < PHASE_COUNT; ++phase)
+    profile->phase_ns[phase] = 0;
+}
+
+
+/* Charges the time elapsed since *since to 'phase' and restarts the
+ * clock. Does nothing if profile is NULL, so unprofiled turns do not
+ * read the clock at all.
+ */
+
+void profile_mark(struct turn_profile *profile, int phase, long long *since)
+{
+  if (profile == NULL)
+    return;
+
+  assert(phase >= 0 && phase < PHASE_COUNT);
+
+  const long long now = profile_clock();
+  profile->phase_ns[phase] += now - *since;
+  *since = now;
+}
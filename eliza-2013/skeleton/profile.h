@@ -0,0 +1,28 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* The phases of a single ELIZA turn, timed by the replay benchmark */
+
+enum
+{
+  PHASE_PREREPLACE,
+  PHASE_TOKENIZE,
+  PHASE_FIND_RULES,
+  PHASE_CHOOSE_RULE,
+  PHASE_RULE_APPLY,
+  PHASE_POSTREPLACE,
+  PHASE_COUNT
+};
+
+struct turn_profile
+{
+  long long phase_ns[PHASE_COUNT];
+};
+
+extern const char *const phase_names[PHASE_COUNT];
+
+long long profile_clock(void);
+void profile_reset(struct turn_profile *profile);
+void profile_mark(struct turn_profile *profile, int phase, long long *since);
+
+#endif
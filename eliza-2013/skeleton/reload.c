@@ -0,0 +1,154 @@
+#include "reload.h"
+#include "eliza_state.h"
+#include "parser.h"
+#include "snapshot.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A published state and the number of references to it. The reloader
+ * itself holds one reference while the version is current. The state
+ * is the first member so a struct eliza_state* handed out by
+ * reload_acquire() can be converted back.
+ */
+
+struct eliza_version
+{
+  struct eliza_state state;
+  int references;
+};
+
+static struct eliza_version *version_load(const char *script_path, const char *snapshot_path);
+static void version_release(struct eliza_version *version);
+
+
+/* Loads a new version from the snapshot if one is configured, from the
+ * script otherwise. Returns NULL if loading fails.
+ */
+
+static struct eliza_version *version_load(const char *script_path, const char *snapshot_path)
+{
+  struct eliza_version *version = malloc(sizeof(struct eliza_version));
+  if (version == NULL)
+  {
+    perror("version_load");
+    exit(EXIT_FAILURE);
+  }
+
+  version->references = 1;
+
+  if (snapshot_path != NULL)
+  {
+    if (snapshot_load(&version->state, snapshot_path) == 0)
+      return version;
+  }
+  else
+  {
+    eliza_init(&version->state);
+    if (parse_eliza_script(&version->state, script_path) == 0)
+      return version;
+
+    eliza_destroy(&version->state);
+  }
+
+  free(version);
+  return NULL;
+}
+
+
+/* Drops a reference to a version, destroying it if it was the last */
+
+static void version_release(struct eliza_version *version)
+{
+  if (__atomic_sub_fetch(&version->references, 1, __ATOMIC_ACQ_REL) == 0)
+  {
+    eliza_destroy(&version->state);
+    free(version);
+  }
+}
+
+
+/* Initialises r and loads its first version: from the snapshot at
+ * snapshot_path if that is non-NULL, otherwise by parsing the script at
+ * script_path. Later reloads read the same file. Returns 0 on success.
+ */
+
+int reload_init(struct reloadable_eliza *r, const char *script_path, const char *snapshot_path)
+{
+  assert(r != NULL);
+  assert(script_path != NULL || snapshot_path != NULL);
+
+  r->script_path = script_path;
+  r->snapshot_path = snapshot_path;
+  r->current = version_load(script_path, snapshot_path);
+
+  if (r->current == NULL)
+    return -1;
+
+  pthread_mutex_init(&r->lock, NULL);
+  return 0;
+}
+
+
+/* Returns the current state with a reference held on it. The state
+ * stays valid, even across reloads, until passed to reload_release().
+ */
+
+struct eliza_state *reload_acquire(struct reloadable_eliza *r)
+{
+  assert(r != NULL);
+
+  pthread_mutex_lock(&r->lock);
+  struct eliza_version *version = r->current;
+  __atomic_add_fetch(&version->references, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&r->lock);
+
+  return &version->state;
+}
+
+
+/* Drops a reference taken by reload_acquire() */
+
+void reload_release(struct eliza_state *eliza)
+{
+  assert(eliza != NULL);
+
+  version_release((struct eliza_version *) eliza);
+}
+
+
+/* Loads a new version and makes it current. The lock is only held for
+ * the pointer exchange, so turns are never delayed by the load. If the
+ * load fails the current version is kept. Returns 0 on success.
+ */
+
+int reload_swap(struct reloadable_eliza *r)
+{
+  assert(r != NULL);
+
+  struct eliza_version *version = version_load(r->script_path, r->snapshot_path);
+  if (version == NULL)
+    return -1;
+
+  pthread_mutex_lock(&r->lock);
+  struct eliza_version *old = r->current;
+  r->current = version;
+  pthread_mutex_unlock(&r->lock);
+
+  version_release(old);
+  return 0;
+}
+
+
+/* Releases the current version. Every reference taken with
+ * reload_acquire() must have been released first.
+ */
+
+void reload_destroy(struct reloadable_eliza *r)
+{
+  assert(r != NULL);
+
+  version_release(r->current);
+  r->current = NULL;
+  pthread_mutex_destroy(&r->lock);
+}
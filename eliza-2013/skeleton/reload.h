@@ -0,0 +1,32 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include "fwd.h"
+#include <pthread.h>
+
+struct eliza_version;
+
+/* An ELIZA state that can be replaced while conversations are using it.
+ * Each turn takes a reference to the current version with
+ * reload_acquire() and drops it with reload_release(). reload_swap()
+ * builds a complete new state from the script (or snapshot) without
+ * holding the lock and then publishes it; the previous version is
+ * destroyed by whichever thread drops its last reference, so turns
+ * already in progress finish on the rules they started with.
+ */
+
+struct reloadable_eliza
+{
+  pthread_mutex_t lock;
+  struct eliza_version *current;
+  const char *script_path;
+  const char *snapshot_path;
+};
+
+int reload_init(struct reloadable_eliza *r, const char *script_path, const char *snapshot_path);
+struct eliza_state *reload_acquire(struct reloadable_eliza *r);
+void reload_release(struct eliza_state *eliza);
+int reload_swap(struct reloadable_eliza *r);
+void reload_destroy(struct reloadable_eliza *r);
+
+#endif
@@ -0,0 +1,237 @@
+#include "replay.h"
+#include "session.h"
+#include "profile.h"
+#include "string_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Per-turn samples gathered during a replay. Column PHASE_COUNT of
+ * each row holds the turn's total latency.
+ */
+
+struct replay_samples
+{
+  long long *ns;
+  size_t turns;
+};
+
+static char **replay_read_corpus(const char *corpus_path, size_t *count);
+static int compare_long_long(const void *a, const void *b);
+static void json_write_string(FILE *out, const char *str);
+static long long percentile(const long long *sorted, size_t count, int percent);
+static void replay_report(FILE *out, const char *corpus_path, int iterations,
+  struct replay_samples *samples, double seconds);
+
+
+/* Reads every line of the corpus into a heap allocated table of heap
+ * allocated strings. Returns NULL if the file cannot be read.
+ */
+
+static char **replay_read_corpus(const char *corpus_path, size_t *count)
+{
+  FILE *file = fopen(corpus_path, "r");
+  if (file == NULL)
+  {
+    perror("replay_read_corpus");
+    return NULL;
+  }
+
+  size_t capacity = 64;
+  char **lines = malloc(capacity * sizeof(char *));
+  if (lines == NULL)
+  {
+    perror("replay_read_corpus");
+    exit(EXIT_FAILURE);
+  }
+
+  *count = 0;
+  char buffer[MAX_INPUT_LENGTH];
+  while(fgets(buffer, sizeof(buffer), file) != NULL)
+  {
+    trim_newline(buffer);
+
+    if (*count == capacity)
+    {
+      capacity *= 2;
+      lines = realloc(lines, capacity * sizeof(char *));
+      if (lines == NULL)
+      {
+        perror("replay_read_corpus");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    lines[(*count)++] = clone(buffer);
+  }
+
+  fclose(file);
+  return lines;
+}
+
+
+/* qsort() comparator for long long */
+
+static int compare_long_long(const void *a, const void *b)
+{
+  const long long x = *(const long long *) a;
+  const long long y = *(const long long *) b;
+  return (x > y) - (x < y);
+}
+
+
+/* Writes str as a quoted JSON string */
+
+static void json_write_string(FILE *out, const char *str)
+{
+  fputc('"', out);
+  for(; *str != '\0'; ++str)
+  {
+    if (*str == '"' || *str == '\\')
+      fputc('\\', out);
+
+    if ((unsigned char) *str >= ' ')
+      fputc(*str, out);
+  }
+  fputc('"', out);
+}
+
+
+/* Returns the nearest-rank percentile of a sorted, non-empty array */
+
+static long long percentile(const long long *sorted, size_t count, int percent)
+{
+  size_t rank = (count * percent + 99) / 100;
+  if (rank == 0)
+    rank = 1;
+
+  return sorted[rank - 1];
+}
+
+
+/* Writes the results of a replay as JSON */
+
+static void replay_report(FILE *out, const char *corpus_path, int iterations,
+  struct replay_samples *samples, double seconds)
+{
+  const size_t turns = samples->turns;
+  long long *column = malloc((turns + 1) * sizeof(long long));
+  if (column == NULL)
+  {
+    perror("replay_report");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"corpus\": ");
+  json_write_string(out, corpus_path);
+  fprintf(out, ",\n");
+  fprintf(out, "  \"iterations\": %d,\n", iterations);
+  fprintf(out, "  \"turns\": %zu,\n", turns);
+  fprintf(out, "  \"seconds\": %.6f,\n", seconds);
+  fprintf(out, "  \"turns_per_second\": %.1f,\n", seconds > 0 ? turns / seconds : 0.0);
+  fprintf(out, "  \"phases\": {\n");
+
+  for(int phase = 0; phase <= PHASE_COUNT; ++phase)
+  {
+    long long sum = 0;
+    for(size_t turn = 0; turn < turns; ++turn)
+    {
+      column[turn] = samples->ns[turn * (PHASE_COUNT + 1) + phase];
+      sum += column[turn];
+    }
+
+    qsort(column, turns, sizeof(long long), &compare_long_long);
+
+    fprintf(out, "    \"%s\": { \"mean_ns\": %.1f, \"p50_ns\": %lld, \"p99_ns\": %lld }%s\n",
+      phase < PHASE_COUNT ? phase_names[phase] : "total",
+      turns > 0 ? (double) sum / turns : 0.0,
+      turns > 0 ? percentile(column, turns, 50) : 0,
+      turns > 0 ? percentile(column, turns, 99) : 0,
+      phase < PHASE_COUNT ? "," : "");
+  }
+
+  fprintf(out, "  }\n");
+  fprintf(out, "}\n");
+  free(column);
+}
+
+
+/* Feeds every line of the corpus at corpus_path through a session,
+ * 'iterations' times over, without any interactive I/O. Throughput and
+ * the latency of each phase of a turn are written as JSON to json_path,
+ * or to stdout if json_path is NULL. Returns 0 on success.
+ */
+
+int replay_run(struct eliza_state *eliza, const char *corpus_path, int iterations, const char *json_path)
+{
+  assert(eliza != NULL);
+  assert(corpus_path != NULL);
+  assert(iterations > 0);
+
+  size_t line_count;
+  char **lines = replay_read_corpus(corpus_path, &line_count);
+  if (lines == NULL)
+    return -1;
+
+  struct replay_samples samples;
+  samples.turns = line_count * iterations;
+  samples.ns = calloc(samples.turns * (PHASE_COUNT + 1) + 1, sizeof(long long));
+  if (samples.ns == NULL)
+  {
+    perror("replay_run");
+    exit(EXIT_FAILURE);
+  }
+
+  struct eliza_session session;
+  session_init(&session, 1);
+
+  const long long start = profile_clock();
+  size_t turn = 0;
+
+  for(int iteration = 0; iteration < iterations; ++iteration)
+  {
+    for(size_t index = 0; index < line_count; ++index, ++turn)
+    {
+      struct turn_profile profile;
+      profile_reset(&profile);
+
+      char *out;
+      const long long turn_start = profile_clock();
+      session_respond(&session, eliza, lines[index], &profile, &out);
+      const long long turn_ns = profile_clock() - turn_start;
+
+      long long *row = &samples.ns[turn * (PHASE_COUNT + 1)];
+      memcpy(row, profile.phase_ns, sizeof(profile.phase_ns));
+      row[PHASE_COUNT] = turn_ns;
+    }
+  }
+
+  const double seconds = (profile_clock() - start) / 1e9;
+  session_destroy(&session);
+
+  int result = 0;
+  FILE *out = json_path != NULL ? fopen(json_path, "w") : stdout;
+  if (out == NULL)
+  {
+    perror("replay_run");
+    result = -1;
+  }
+  else
+  {
+    replay_report(out, corpus_path, iterations, &samples, seconds);
+    if (out != stdout)
+      fclose(out);
+  }
+
+  fprintf(stderr, "Replayed %zu turns in %.3fs (%.1f turns/s)\n",
+    samples.turns, seconds, seconds > 0 ? samples.turns / seconds : 0.0);
+
+  for(size_t index = 0; index < line_count; ++index)
+    free(lines[index]);
+
+  free(lines);
+  free(samples.ns);
+  return result;
+}
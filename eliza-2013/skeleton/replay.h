@@ -0,0 +1,8 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "fwd.h"
+
+int replay_run(struct eliza_state *eliza, const char *corpus_path, int iterations, const char *json_path);
+
+#endif
@@ -2,20 +2,39 @@
 #include "error_codes.h"
 #include "string_utils.h"
 #include "list.h"
+#include "map.h"
 #include "eliza_state.h"
 #include "parser.h"
+#include "arena.h"
+#include "profile.h"
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <assert.h>
 #include <pcreposix.h>
 
+enum
+{
+  INITIAL_CANDIDATE_CAPACITY = 16
+};
+
 static char *decomp_to_regex(const char* decomp);
-static char* get_goto_target(struct eliza_state *eliza, char* reasmb);
-static char* get_match_value(const char* str, regmatch_t match);
-static char* substitute_matches(struct eliza_state *eliza,
-  const char *template, const char* input, const regmatch_t *matches);
+static char* get_goto_target(char* reasmb);
+static char* get_match_value(struct arena *arena, const char* str, regmatch_t match);
+static int template_reference(const char *pos, const char *end);
+static void rewrite_matches(struct eliza_state *eliza, struct arena *arena,
+  const char *template, const char* input, const regmatch_t *matches, char **values);
+static char* substitute_matches(struct arena *arena, const char *template, char **values);
+
+/* A rule's decomp pattern, compiled once when the script is loaded */
+
+struct rule_pattern
+{
+  regex_t regex;
+  int compiled;
+};
 
 /* Transforms a decomp rule into the string representation of a regular
  * expression.
@@ -54,7 +73,7 @@ char *decomp_to_regex(const char* decomp)
 /* Given a rasmb string, return the name of a goto target. Otherwise,
  * return NULL if reasmb is not a goto.
  */
-char* get_goto_target(struct eliza_state *eliza, char* reasmb)
+char* get_goto_target(char* reasmb)
 {
   char **tokens;
   char *str_temp = clone(reasmb);
@@ -74,29 +93,39 @@ char* get_goto_target(struct eliza_state *eliza, char* reasmb)
  * 'text'. The result are added to the list 'out'.
  */
 
-void find_rules(struct eliza_state *eliza, const char *key, const char *text, struct list *out)
+void find_rules(struct eliza_state *eliza, const char *key, const char *text, struct rule_candidates *out)
 {
   assert(eliza != NULL);
   assert(key != NULL);
   assert(out != NULL);
 
-  for(list_iter rule_iter = list_begin(&eliza->rules);
-      rule_iter != list_end(&eliza->rules);
+  struct list *rules = (struct list *) map_lookup(&eliza->keywords, key);
+  if (rules != NULL)
+    find_keyword_rules(eliza, rules, text, out);
+}
+
+
+/* As find_rules(), but takes the list of rules sharing a key (a value
+ * of eliza->keywords) instead of the key itself.
+ */
+
+void find_keyword_rules(struct eliza_state *eliza, struct list *rules, const char *text, struct rule_candidates *out)
+{
+  assert(eliza != NULL);
+  assert(rules != NULL);
+  assert(out != NULL);
+
+  for(list_iter rule_iter = list_begin(rules);
+      rule_iter != list_end(rules);
       rule_iter = list_iter_next(rule_iter))
   {
     struct rule *rule = (struct rule*) list_iter_value(rule_iter);
-    if (strcmp(rule->key, key) == 0 && rule_applies(eliza, rule, text))
+    if (rule_applies(eliza, rule, text))
     {
-      char *next = get_goto_target(eliza, rule->reasmb);
-      if (next == NULL)
-      {
-        list_insert_front(out, rule);
-      }
+      if (rule->target == NULL)
+        rule_candidates_add(out, rule);
       else
-      {
-        find_rules(eliza, next, text, out);
-        free(next);
-      }
+        find_rules(eliza, rule->target, text, out);
     }
   }
 }
@@ -112,65 +141,93 @@ int rule_applies(struct eliza_state *eliza, struct rule* rule, const char *text)
   assert(rule != NULL);
   assert(text != NULL);
 
-  char *decomp_regex_text = decomp_to_regex(rule->decomp);
-
-  regex_t decomp_regex;
-  if (regcomp(&decomp_regex, decomp_regex_text, REG_UTF8 | REG_NOSUB) != 0)
+  const struct rule_pattern *pattern = &eliza->patterns[rule->id];
+  if (!pattern->compiled)
     return 0;
 
-  int match_result = regexec(&decomp_regex, text, 0, 0, 0);
-  regfree(&decomp_regex);
-  free(decomp_regex_text);
-
-  return (match_result == 0);
+  return regexec(&pattern->regex, text, 0, 0, 0) == 0;
 }
 
 
 /* Returns the string corresponding to the regular expression match
- * match. The returned string should be freed after use.
+ * match, allocated in the arena.
  */
 
-char* get_match_value(const char* str, regmatch_t match)
+char* get_match_value(struct arena *arena, const char* str, regmatch_t match)
 {
   if (match.rm_so == -1)
   {
-    return empty_string();
+    return arena_clone(arena, "");
   }
   else
   {
     const int length = match.rm_eo - match.rm_so;
-    char *result = malloc(length + 1);
+    char *result = arena_alloc(arena, length + 1);
     memcpy(result, str+match.rm_so, length);
     result[length] = '\0';
     return result;
   }
 }
 
-/* Substitute regular expression matches into a template */
+/* Returns the match number referenced by the template text at pos if it
+ * is of the form "(n)", or -1 otherwise.
+ */
 
-char* substitute_matches(struct eliza_state *eliza, const char *template, const char* input, const regmatch_t *matches)
+int template_reference(const char *pos, const char *end)
+{
+  if (end - pos >= 3 && pos[0] == '(' && pos[2] == ')' && pos[1] >= '0' && pos[1] <= '9')
+    return pos[1] - '0';
+
+  return -1;
+}
+
+
+/* Rewrites each regular expression match referenced by the template
+ * with the post-replacement map. values[n] receives the rewritten text
+ * of match n, allocated in the arena; unreferenced entries are left
+ * alone.
+ */
+
+void rewrite_matches(struct eliza_state *eliza, struct arena *arena, const char *template, const char* input, const regmatch_t *matches, char **values)
+{
+  const char* end = template + strlen(template);
+
+  for(const char *pos = template; pos != end; ++pos)
+  {
+    const int match = template_reference(pos, end);
+
+    if (match >= 0 && values[match] == NULL)
+    {
+      char *real_value = get_match_value(arena, input, matches[match]);
+      values[match] = rewrite_string(arena, &eliza->postreplace, real_value);
+    }
+  }
+}
+
+
+/* Substitute rewritten regular expression matches into a template. The
+ * result is allocated in the arena.
+ */
+
+char* substitute_matches(struct arena *arena, const char *template, char **values)
 {
   const size_t template_length = strlen(template);
   const char* end = template + template_length;
-  char *result = empty_string();
+  char *result = arena_clone(arena, "");
 
   for(const char *pos = template; pos != end;)
   {
-    if (end - pos >= 3 && pos[0] == '(' && pos[2] == ')' && pos[1] >= '0' && pos[1] <= '9')
+    const int match = template_reference(pos, end);
+
+    if (match >= 0)
     {
-      char pos_str[] = {pos[1], '\0'};
-      int match = atoi(pos_str);
-      char *real_value = get_match_value(input, matches[match]);
-      char *rewritten = rewrite_string(&eliza->postreplace, real_value);
-      free(real_value);
-      result = push_string(result, rewritten);
-      free(rewritten);
+      result = arena_append(arena, result, values[match]);
       pos += 3;
     }
     else
     {
       char char_str[] = {*pos, '\0'};
-      result = push_string(result, char_str);
+      result = arena_append(arena, result, char_str);
       ++pos;
     }
   }
@@ -179,32 +236,40 @@ char* substitute_matches(struct eliza_state *eliza, const char *template, const
 }
 
 
-/* Apply rule to input string str and return result in *out. If
- * application succeeds, return 0, otherwise returns a non-zero value.
+/* Apply rule to input string str and return result in *out, allocated
+ * in the arena. If application succeeds, return 0, otherwise returns a
+ * non-zero value. If profile is non-NULL, the time spent rewriting the
+ * matches is charged to PHASE_POSTREPLACE and the rest to
+ * PHASE_RULE_APPLY.
  */
 
-int rule_apply(struct eliza_state *eliza, struct rule *rule, const char *str, char **out)
+int rule_apply(struct eliza_state *eliza, struct rule *rule, const char *str, struct arena *arena,
+  struct turn_profile *profile, char **out)
 {
   assert(eliza != NULL);
   assert(rule != NULL);
   assert(str != NULL);
+  assert(arena != NULL);
   assert(out != NULL);
 
-  char *decomp_regex_str = decomp_to_regex(rule->decomp);
-
-  regex_t decomp_regex;
+  const struct rule_pattern *pattern = &eliza->patterns[rule->id];
   regmatch_t matches[10];
+  char *values[10] = { NULL };
+  long long since = profile != NULL ? profile_clock() : 0;
 
-  if (regcomp(&decomp_regex, decomp_regex_str, REG_UTF8) != 0)
+  if (!pattern->compiled)
     return REGEX_FAILURE;
 
-  int match_result = regexec(&decomp_regex, str, sizeof(matches)/sizeof(regmatch_t), matches, 0);
-  regfree(&decomp_regex);
-  free(decomp_regex_str);
+  int match_result = regexec(&pattern->regex, str, sizeof(matches)/sizeof(regmatch_t), matches, 0);
+  profile_mark(profile, PHASE_RULE_APPLY, &since);
 
   if (match_result == 0)
   {
-    *out = substitute_matches(eliza, rule->reasmb, str, matches);
+    rewrite_matches(eliza, arena, rule->reasmb, str, matches, values);
+    profile_mark(profile, PHASE_POSTREPLACE, &since);
+
+    *out = substitute_matches(arena, rule->reasmb, values);
+    profile_mark(profile, PHASE_RULE_APPLY, &since);
     return 0;
   }
 
@@ -212,51 +277,130 @@ int rule_apply(struct eliza_state *eliza, struct rule *rule, const char *str, ch
 }
 
 
-/* Finds the higest scoring rule in rules */
+/* Initialises an empty set of candidate rules allocated from arena */
 
-int highest_scoring_rule(struct list* rules)
+void rule_candidates_init(struct rule_candidates *candidates, struct arena *arena)
 {
-  assert(!list_empty(rules));
-  int max = INT_MIN;
+  assert(candidates != NULL);
+  assert(arena != NULL);
+
+  candidates->arena = arena;
+  candidates->capacity = INITIAL_CANDIDATE_CAPACITY;
+  candidates->rules = arena_alloc(arena, candidates->capacity * sizeof(struct rule*));
+  candidates->count = 0;
+  candidates->precedence = INT_MIN;
+}
 
-  for(list_iter rule_iter = list_begin(rules);
-      rule_iter != list_end(rules);
-      rule_iter = list_iter_next(rule_iter))
+
+/* Adds a rule to the candidates. A rule of higher precedence than the
+ * current candidates replaces them all; a rule of lower precedence is
+ * ignored.
+ */
+
+void rule_candidates_add(struct rule_candidates *candidates, struct rule *rule)
+{
+  assert(candidates != NULL);
+  assert(rule != NULL);
+
+  if (rule->precedence < candidates->precedence)
+    return;
+
+  if (rule->precedence > candidates->precedence)
   {
-    struct rule *rule = (struct rule*) list_iter_value(rule_iter);
-    if (rule->precedence > max)
-      max = rule->precedence;
+    candidates->precedence = rule->precedence;
+    candidates->count = 0;
+  }
+
+  if (candidates->count == candidates->capacity)
+  {
+    struct rule **rules = arena_alloc(candidates->arena, 2 * candidates->capacity * sizeof(struct rule*));
+    memcpy(rules, candidates->rules, candidates->count * sizeof(struct rule*));
+    candidates->rules = rules;
+    candidates->capacity *= 2;
   }
-  return max;
+
+  candidates->rules[candidates->count++] = rule;
 }
 
 
-/* Chooses a rule to apply from the list rules using some metric */
+/* Chooses one of the candidates, which all share the highest precedence
+ * found. Ties are broken using the random state in *seed.
+ */
 
-struct rule *choose_rule(struct list* rules)
+struct rule *choose_rule(struct rule_candidates *candidates, unsigned int *seed)
 {
-  assert(!list_empty(rules));
+  assert(candidates != NULL);
+  assert(candidates->count > 0);
+  assert(seed != NULL);
 
-  struct list best_rules;
-  list_init(&best_rules);
+  return candidates->rules[rand_r(seed) % candidates->count];
+}
 
-  const int best_score = highest_scoring_rule(rules);
 
-  for(list_iter rule_iter = list_begin(rules);
-      rule_iter != list_end(rules);
+/* Derives the parts of a rule that depend only on the script: the
+ * regular expression for its decomp pattern and its goto target (NULL
+ * if the rule is not a goto). Called once when the rule is loaded so
+ * that turns do not have to recompute them.
+ */
+
+void rule_prepare(struct rule *rule)
+{
+  assert(rule != NULL);
+
+  rule->pattern = decomp_to_regex(rule->decomp);
+  rule->target = get_goto_target(rule->reasmb);
+}
+
+
+/* Compiles the decomp pattern of every rule in eliza. A pattern that
+ * fails to compile is reported and its rule never matches.
+ */
+
+void rule_compile_patterns(struct eliza_state *eliza)
+{
+  assert(eliza != NULL);
+  assert(eliza->patterns == NULL);
+
+  eliza->patterns = calloc(eliza->rule_count + 1, sizeof(struct rule_pattern));
+  if (eliza->patterns == NULL)
+  {
+    perror("rule_compile_patterns");
+    exit(EXIT_FAILURE);
+  }
+
+  for(list_iter rule_iter = list_begin(&eliza->rules);
+      rule_iter != list_end(&eliza->rules);
       rule_iter = list_iter_next(rule_iter))
   {
     struct rule *rule = (struct rule*) list_iter_value(rule_iter);
-    if (rule->precedence == best_score)
-      list_insert_front(&best_rules, rule);
+    struct rule_pattern *pattern = &eliza->patterns[rule->id];
+
+    assert(rule->id < eliza->rule_count);
+    pattern->compiled = regcomp(&pattern->regex, rule->pattern, REG_UTF8) == 0;
+
+    if (!pattern->compiled)
+      fprintf(stderr, "Unable to compile decomp pattern: %s\n", rule->decomp);
   }
+}
 
-  const int rule_count = list_size(&best_rules);
-  const int rule_index = rand() % rule_count;
-  struct rule *chosen = list_get_elem(rules, rule_index);
 
-  list_destroy(&best_rules);
-  return chosen;
+/* Frees the patterns compiled by rule_compile_patterns() */
+
+void rule_free_patterns(struct eliza_state *eliza)
+{
+  assert(eliza != NULL);
+
+  if (eliza->patterns == NULL)
+    return;
+
+  for(size_t index = 0; index < eliza->rule_count; ++index)
+  {
+    if (eliza->patterns[index].compiled)
+      regfree(&eliza->patterns[index].regex);
+  }
+
+  free(eliza->patterns);
+  eliza->patterns = NULL;
 }
 
 
@@ -265,5 +409,8 @@ struct rule *choose_rule(struct list* rules)
 void destroy_rule(struct rule *rule)
 {
   free(rule->key);
+  free(rule->decomp);
   free(rule->reasmb);
+  free(rule->pattern);
+  free(rule->target);
 }
@@ -3,22 +3,50 @@
 
 #include <string.h>
 
+#include <stddef.h>
+
 struct eliza_state;
 struct list;
+struct arena;
+struct turn_profile;
 
 struct rule
 {
   char *key;
   char *decomp;
   char *reasmb;
+  char *pattern;
+  char *target;
+  size_t id;
+  int precedence;
+};
+
+/* The rules that could answer a line of input. Only the rules with the
+ * highest precedence added so far are kept, in an array allocated from
+ * the arena, so the best rules are known as soon as the last one has
+ * been added.
+ */
+
+struct rule_candidates
+{
+  struct arena *arena;
+  struct rule **rules;
+  size_t count;
+  size_t capacity;
   int precedence;
 };
 
-int rule_apply(struct eliza_state *eliza, struct rule *rule, const char *str, char **out);
+int rule_apply(struct eliza_state *eliza, struct rule *rule, const char *str, struct arena *arena,
+  struct turn_profile *profile, char **out);
 int rule_applies(struct eliza_state *eliza, struct rule* rule, const char *text);
-void find_rules(struct eliza_state *eliza, const char *key, const char *text, struct list *out);
-int highest_scoring_rule(struct list* rules);
-struct rule *choose_rule(struct list* rules);
+void find_rules(struct eliza_state *eliza, const char *key, const char *text, struct rule_candidates *out);
+void find_keyword_rules(struct eliza_state *eliza, struct list *rules, const char *text, struct rule_candidates *out);
+void rule_candidates_init(struct rule_candidates *candidates, struct arena *arena);
+void rule_candidates_add(struct rule_candidates *candidates, struct rule *rule);
+struct rule *choose_rule(struct rule_candidates *candidates, unsigned int *seed);
+void rule_prepare(struct rule *rule);
+void rule_compile_patterns(struct eliza_state *eliza);
+void rule_free_patterns(struct eliza_state *eliza);
 void destroy_rule(struct rule *rule);
 
 #endif
@@ -0,0 +1,270 @@
+#include "scanner.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+  INITIAL_KEYWORD_CAPACITY = 64,
+  NO_STATE = -1,
+  ROOT_STATE = 0
+};
+
+static void *scanner_alloc(size_t count, size_t size);
+static int scanner_new_state(struct keyword_scanner *s, int *state_capacity);
+
+
+/* Allocates an array of count elements of the given size. An empty
+ * array still gets a valid pointer, since malloc(0) may return NULL.
+ */
+
+static void *scanner_alloc(size_t count, size_t size)
+{
+  if (size != 0 && count > SIZE_MAX / size)
+  {
+    fprintf(stderr, "scanner_alloc: %zu elements of %zu bytes is too large\n", count, size);
+    exit(EXIT_FAILURE);
+  }
+
+  void *memory = malloc(count == 0 || size == 0 ? 1 : count * size);
+  if (memory == NULL)
+  {
+    perror("scanner_alloc");
+    exit(EXIT_FAILURE);
+  }
+
+  return memory;
+}
+
+
+/* Appends a state with no transitions and no match to the trie */
+
+static int scanner_new_state(struct keyword_scanner *s, int *state_capacity)
+{
+  if (s->state_count == *state_capacity)
+  {
+    *state_capacity *= 2;
+    s->next = realloc(s->next, (size_t) *state_capacity * s->class_count * sizeof(int));
+    s->match = realloc(s->match, (size_t) *state_capacity * sizeof(int));
+    if (s->next == NULL || s->match == NULL)
+    {
+      perror("scanner_new_state");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  const int state = s->state_count++;
+  for(int c = 0; c < s->class_count; ++c)
+    s->next[state * s->class_count + c] = NO_STATE;
+
+  s->match[state] = NO_STATE;
+  return state;
+}
+
+
+/* Initialises an empty scanner */
+
+void scanner_init(struct keyword_scanner *s)
+{
+  assert(s != NULL);
+
+  s->keyword_count = 0;
+  s->keyword_capacity = INITIAL_KEYWORD_CAPACITY;
+  s->keywords = scanner_alloc(s->keyword_capacity, sizeof(const char *));
+  s->lengths = scanner_alloc(s->keyword_capacity, sizeof(size_t));
+  s->values = scanner_alloc(s->keyword_capacity, sizeof(void *));
+  s->class_count = 0;
+  s->state_count = 0;
+  s->next = NULL;
+  s->match = NULL;
+  s->match_link = NULL;
+}
+
+
+/* Adds a keyword, and the value reported with its hits, to a scanner
+ * that has not yet been built. The keyword is not copied. Adding a
+ * keyword a second time has no effect.
+ */
+
+void scanner_add(struct keyword_scanner *s, const char *keyword, void *value)
+{
+  assert(s != NULL);
+  assert(keyword != NULL && *keyword != '\0');
+  assert(s->next == NULL);
+
+  if (s->keyword_count == s->keyword_capacity)
+  {
+    s->keyword_capacity *= 2;
+    s->keywords = realloc(s->keywords, s->keyword_capacity * sizeof(const char *));
+    s->lengths = realloc(s->lengths, s->keyword_capacity * sizeof(size_t));
+    s->values = realloc(s->values, s->keyword_capacity * sizeof(void *));
+    if (s->keywords == NULL || s->lengths == NULL || s->values == NULL)
+    {
+      perror("scanner_add");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  s->keywords[s->keyword_count] = keyword;
+  s->lengths[s->keyword_count] = strlen(keyword);
+  s->values[s->keyword_count] = value;
+  ++s->keyword_count;
+}
+
+
+/* Compiles the keywords into the automaton. Bytes are first mapped to
+ * classes (class 0 for every byte that appears in no keyword) to keep
+ * the transition table small. The keywords are inserted into a trie
+ * whose missing transitions are then filled in breadth first from the
+ * failure links, giving a DFA. match_link chains each state to the
+ * next shorter suffix state that completes a keyword.
+ */
+
+void scanner_build(struct keyword_scanner *s)
+{
+  assert(s != NULL);
+  assert(s->next == NULL);
+
+  memset(s->classes, 0, sizeof(s->classes));
+  s->class_count = 1;
+  for(size_t k = 0; k < s->keyword_count; ++k)
+  {
+    for(const char *c = s->keywords[k]; *c != '\0'; ++c)
+    {
+      if (s->classes[(unsigned char) *c] == 0)
+        s->classes[(unsigned char) *c] = s->class_count++;
+    }
+  }
+
+  int state_capacity = 64;
+  s->next = scanner_alloc((size_t) state_capacity * s->class_count, sizeof(int));
+  s->match = scanner_alloc(state_capacity, sizeof(int));
+  scanner_new_state(s, &state_capacity);
+
+  for(size_t k = 0; k < s->keyword_count; ++k)
+  {
+    int state = ROOT_STATE;
+    for(const char *c = s->keywords[k]; *c != '\0'; ++c)
+    {
+      const int cls = s->classes[(unsigned char) *c];
+      if (s->next[state * s->class_count + cls] == NO_STATE)
+      {
+        const int child = scanner_new_state(s, &state_capacity);
+        s->next[state * s->class_count + cls] = child;
+      }
+      state = s->next[state * s->class_count + cls];
+    }
+
+    if (s->match[state] == NO_STATE)
+      s->match[state] = k;
+  }
+
+  int *fail = scanner_alloc(s->state_count, sizeof(int));
+  int *queue = scanner_alloc(s->state_count, sizeof(int));
+  s->match_link = scanner_alloc(s->state_count, sizeof(int));
+
+  int head = 0, tail = 0;
+  fail[ROOT_STATE] = ROOT_STATE;
+  s->match_link[ROOT_STATE] = ROOT_STATE;
+
+  for(int c = 0; c < s->class_count; ++c)
+  {
+    int *child = &s->next[ROOT_STATE * s->class_count + c];
+    if (*child == NO_STATE)
+    {
+      *child = ROOT_STATE;
+    }
+    else
+    {
+      fail[*child] = ROOT_STATE;
+      s->match_link[*child] = ROOT_STATE;
+      queue[tail++] = *child;
+    }
+  }
+
+  while (head < tail)
+  {
+    const int state = queue[head++];
+    for(int c = 0; c < s->class_count; ++c)
+    {
+      int *child = &s->next[state * s->class_count + c];
+      const int fallback = s->next[fail[state] * s->class_count + c];
+
+      if (*child == NO_STATE)
+      {
+        *child = fallback;
+      }
+      else
+      {
+        fail[*child] = fallback;
+        s->match_link[*child] = s->match[fallback] != NO_STATE ? fallback : s->match_link[fallback];
+        queue[tail++] = *child;
+      }
+    }
+  }
+
+  free(queue);
+  free(fail);
+}
+
+
+/* Scans text in a single pass, calling callback for every whole-word
+ * keyword hit in order of the position at which it ends. Overlapping
+ * hits are all reported. Returns the number of hits.
+ */
+
+size_t scanner_scan(const struct keyword_scanner *s, const char *text,
+  scanner_callback callback, void *context)
+{
+  assert(s != NULL);
+  assert(s->next != NULL);
+  assert(text != NULL);
+
+  size_t hits = 0;
+  int state = ROOT_STATE;
+
+  for(size_t position = 0; text[position] != '\0'; ++position)
+  {
+    state = s->next[state * s->class_count + s->classes[(unsigned char) text[position]]];
+
+    int found = s->match[state] != NO_STATE ? state : s->match_link[state];
+    for(; found != ROOT_STATE; found = s->match_link[found])
+    {
+      const int keyword = s->match[found];
+      const size_t end = position + 1;
+      const size_t start = end - s->lengths[keyword];
+
+      if (start > 0 && text[start - 1] != ' ')
+        continue;
+
+      if (text[end] != '\0' && text[end] != ' ')
+        continue;
+
+      struct keyword_hit hit;
+      hit.keyword = s->keywords[keyword];
+      hit.value = s->values[keyword];
+      hit.start = start;
+      hit.end = end;
+
+      callback(context, &hit);
+      ++hits;
+    }
+  }
+
+  return hits;
+}
+
+
+/* Frees the memory held by the scanner */
+
+void scanner_destroy(struct keyword_scanner *s)
+{
+  free(s->keywords);
+  free(s->lengths);
+  free(s->values);
+  free(s->next);
+  free(s->match);
+  free(s->match_link);
+}
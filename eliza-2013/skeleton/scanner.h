@@ -0,0 +1,50 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stddef.h>
+
+/* An Aho-Corasick automaton over a fixed set of keywords. Keywords are
+ * added with scanner_add() and compiled by scanner_build() into a DFA
+ * over the bytes that occur in them, so scanning costs one table lookup
+ * per input byte however many keywords there are. Only whole-word
+ * matches are reported: a hit must start and end at the edge of the
+ * text or next to a space. Keywords may themselves contain spaces.
+ *
+ * A built scanner is only read by scanner_scan(), so it may be shared
+ * between threads.
+ */
+
+struct keyword_hit
+{
+  const char *keyword;
+  void *value;
+  size_t start;
+  size_t end;
+};
+
+typedef void (*scanner_callback)(void *context, const struct keyword_hit *hit);
+
+struct keyword_scanner
+{
+  size_t keyword_count;
+  size_t keyword_capacity;
+  const char **keywords;
+  size_t *lengths;
+  void **values;
+
+  unsigned char classes[256];
+  int class_count;
+  int state_count;
+  int *next;
+  int *match;
+  int *match_link;
+};
+
+void scanner_init(struct keyword_scanner *s);
+void scanner_add(struct keyword_scanner *s, const char *keyword, void *value);
+void scanner_build(struct keyword_scanner *s);
+size_t scanner_scan(const struct keyword_scanner *s, const char *text,
+  scanner_callback callback, void *context);
+void scanner_destroy(struct keyword_scanner *s);
+
+#endif
@@ -0,0 +1,627 @@
+#include "server.h"
+#include "session.h"
+#include "eliza_state.h"
+#include "reload.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+enum
+{
+  LISTEN_BACKLOG = 128,
+  INITIAL_OUTPUT_CAPACITY = 512,
+  MAX_PENDING_OUTPUT = 64 * 1024
+};
+
+/* One client connection. A connection is registered with EPOLLONESHOT,
+ * so at most one worker owns it at any time and its fields need no
+ * locking. Only the prev/next links are shared, under server->lock.
+ */
+
+struct connection
+{
+  int fd;
+  int closing;
+  struct eliza_session session;
+  char input[MAX_INPUT_LENGTH];
+  size_t input_length;
+  char *output;
+  size_t output_length;
+  size_t output_sent;
+  size_t output_capacity;
+  struct connection *prev;
+  struct connection *next;
+};
+
+struct server
+{
+  struct reloadable_eliza *eliza;
+  int epoll_fd;
+  int listen_fd;
+  int shutdown_pipe[2];
+  pthread_mutex_t lock;
+  unsigned int next_seed;
+  struct connection *connections;
+};
+
+/* Addresses used to tag the non-connection descriptors in epoll */
+static char listener_tag;
+static char shutdown_tag;
+
+static const char *no_rule_reply = "<failed to find *any* usable rule>";
+
+static int set_nonblocking(int fd);
+static int server_listen(const char *socket_path);
+static void server_arm(struct server *server, int fd, void *tag, uint32_t events, int op);
+static struct connection *connection_create(struct server *server, int fd);
+static void connection_destroy(struct server *server, struct connection *c);
+static void connection_queue(struct connection *c, const char *str);
+static int connection_flush(struct connection *c);
+static int connection_backlogged(const struct connection *c);
+static void connection_respond(struct server *server, struct connection *c, const char *line);
+static void connection_process_input(struct server *server, struct connection *c);
+static void server_accept(struct server *server);
+static void server_service(struct server *server, struct connection *c, uint32_t events);
+static void *server_worker(void *arg);
+
+
+/* Puts the file descriptor fd into non-blocking mode. Returns 0 on
+ * success.
+ */
+
+static int set_nonblocking(int fd)
+{
+  const int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0)
+    return -1;
+
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+/* Creates a non-blocking listening socket bound to socket_path. Any
+ * stale socket file at that path is removed first. Returns the socket,
+ * or -1 on failure.
+ */
+
+static int server_listen(const char *socket_path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (strlen(socket_path) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "Socket path too long: %s\n", socket_path);
+    return -1;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    perror("socket");
+    return -1;
+  }
+
+  unlink(socket_path);
+  if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0
+      || listen(fd, LISTEN_BACKLOG) != 0
+      || set_nonblocking(fd) != 0)
+  {
+    perror("server_listen");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+/* Registers (op == EPOLL_CTL_ADD) or re-arms (op == EPOLL_CTL_MOD) fd
+ * in the server's epoll set.
+ */
+
+static void server_arm(struct server *server, int fd, void *tag, uint32_t events, int op)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = tag;
+
+  if (epoll_ctl(server->epoll_fd, op, fd, &event) != 0)
+  {
+    perror("epoll_ctl");
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+/* Allocates a connection for the accepted socket fd and links it into
+ * the server's connection list.
+ */
+
+static struct connection *connection_create(struct server *server, int fd)
+{
+  struct connection *c = malloc(sizeof(struct connection));
+  if (c == NULL)
+  {
+    perror("connection_create");
+    exit(EXIT_FAILURE);
+  }
+
+  c->fd = fd;
+  c->closing = 0;
+  c->input_length = 0;
+  c->output = NULL;
+  c->output_length = 0;
+  c->output_sent = 0;
+  c->output_capacity = 0;
+  c->prev = NULL;
+
+  pthread_mutex_lock(&server->lock);
+  session_init(&c->session, server->next_seed++);
+  c->next = server->connections;
+  if (server->connections != NULL)
+    server->connections->prev = c;
+  server->connections = c;
+  pthread_mutex_unlock(&server->lock);
+
+  return c;
+}
+
+
+/* Closes the connection and frees the memory it holds */
+
+static void connection_destroy(struct server *server, struct connection *c)
+{
+  pthread_mutex_lock(&server->lock);
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    server->connections = c->next;
+
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+  pthread_mutex_unlock(&server->lock);
+
+  session_destroy(&c->session);
+  close(c->fd);
+  free(c->output);
+  free(c);
+}
+
+
+/* Appends str to the connection's pending output */
+
+static void connection_queue(struct connection *c, const char *str)
+{
+  const size_t length = strlen(str);
+
+  /* Drop what has been sent before growing, so the buffer stays near
+   * MAX_PENDING_OUTPUT for a slow reader */
+  if (c->output_length + length > c->output_capacity && c->output_sent > 0)
+  {
+    c->output_length -= c->output_sent;
+    memmove(c->output, c->output + c->output_sent, c->output_length);
+    c->output_sent = 0;
+  }
+
+  if (c->output_length + length > c->output_capacity)
+  {
+    size_t capacity = c->output_capacity == 0 ? INITIAL_OUTPUT_CAPACITY : c->output_capacity;
+    while (capacity < c->output_length + length)
+      capacity *= 2;
+
+    char *output = realloc(c->output, capacity);
+    if (output == NULL)
+    {
+      perror("connection_queue");
+      exit(EXIT_FAILURE);
+    }
+
+    c->output = output;
+    c->output_capacity = capacity;
+  }
+
+  memcpy(c->output + c->output_length, str, length);
+  c->output_length += length;
+}
+
+
+/* Writes as much pending output as the socket accepts. Returns 0 if the
+ * connection is still usable (whether or not output remains), -1 if
+ * the peer has gone away.
+ */
+
+static int connection_flush(struct connection *c)
+{
+  while (c->output_sent < c->output_length)
+  {
+    const ssize_t sent = send(c->fd, c->output + c->output_sent,
+      c->output_length - c->output_sent, MSG_NOSIGNAL);
+
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+
+      return -1;
+    }
+
+    c->output_sent += sent;
+  }
+
+  c->output_length = 0;
+  c->output_sent = 0;
+  return 0;
+}
+
+
+/* Returns 1 if the client has left more than MAX_PENDING_OUTPUT unread.
+ * Its input is then left in the socket until it catches up, so that a
+ * client that never reads cannot make the server buffer without bound.
+ */
+
+static int connection_backlogged(const struct connection *c)
+{
+  return c->output_length - c->output_sent > MAX_PENDING_OUTPUT;
+}
+
+
+/* Queues ELIZA's reply to a single line of input */
+
+static void connection_respond(struct server *server, struct connection *c, const char *line)
+{
+  char *out;
+  struct eliza_state *eliza = reload_acquire(server->eliza);
+
+  switch (session_respond(&c->session, eliza, line, NULL, &out))
+  {
+    case SESSION_REPLY:
+      connection_queue(c, out);
+      break;
+
+    case SESSION_QUIT:
+      connection_queue(c, eliza->end);
+      c->closing = 1;
+      break;
+
+    case SESSION_NO_RULE:
+      connection_queue(c, no_rule_reply);
+      break;
+
+    default:
+      break;
+  }
+
+  /* Every line gets exactly one line back so clients can stay in step */
+  connection_queue(c, "\n");
+  reload_release(eliza);
+}
+
+
+/* Responds to every complete line in the connection's input buffer. A
+ * line that does not fit in the buffer is split, as fgets() would.
+ */
+
+static void connection_process_input(struct server *server, struct connection *c)
+{
+  size_t start = 0;
+
+  for(size_t index = 0; index < c->input_length && !c->closing; ++index)
+  {
+    if (c->input[index] == '\n')
+    {
+      c->input[index] = '\0';
+      connection_respond(server, c, c->input + start);
+      start = index + 1;
+    }
+  }
+
+  if (c->closing)
+  {
+    c->input_length = 0;
+    return;
+  }
+
+  c->input_length -= start;
+  memmove(c->input, c->input + start, c->input_length);
+
+  if (c->input_length == sizeof(c->input) - 1)
+  {
+    c->input[c->input_length] = '\0';
+    connection_respond(server, c, c->input);
+    c->input_length = 0;
+  }
+}
+
+
+/* Accepts every pending connection, greets each one and hands it to
+ * epoll. The listener is re-armed afterwards.
+ */
+
+static void server_accept(struct server *server)
+{
+  for(;;)
+  {
+    const int fd = accept(server->listen_fd, NULL, NULL);
+
+    if (fd < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept");
+
+      break;
+    }
+
+    if (set_nonblocking(fd) != 0)
+    {
+      perror("server_accept");
+      close(fd);
+      continue;
+    }
+
+    struct connection *c = connection_create(server, fd);
+    struct eliza_state *eliza = reload_acquire(server->eliza);
+    connection_queue(c, eliza->begin);
+    connection_queue(c, "\n");
+    reload_release(eliza);
+
+    if (connection_flush(c) != 0)
+    {
+      connection_destroy(server, c);
+      continue;
+    }
+
+    uint32_t events = EPOLLIN | EPOLLONESHOT;
+    if (c->output_length > 0)
+      events |= EPOLLOUT;
+
+    server_arm(server, fd, c, events, EPOLL_CTL_ADD);
+  }
+
+  server_arm(server, server->listen_fd, &listener_tag, EPOLLIN | EPOLLONESHOT, EPOLL_CTL_MOD);
+}
+
+
+/* Handles readiness on a client connection, then either re-arms it or
+ * tears it down.
+ */
+
+static void server_service(struct server *server, struct connection *c, uint32_t events)
+{
+  if (events & EPOLLERR)
+  {
+    connection_destroy(server, c);
+    return;
+  }
+
+  if (!c->closing && (events & (EPOLLIN | EPOLLHUP)))
+  {
+    for(;;)
+    {
+      if (connection_backlogged(c))
+      {
+        if (connection_flush(c) != 0)
+        {
+          connection_destroy(server, c);
+          return;
+        }
+
+        if (connection_backlogged(c))
+          break;
+      }
+
+      const ssize_t received = read(c->fd, c->input + c->input_length,
+        sizeof(c->input) - 1 - c->input_length);
+
+      if (received < 0)
+      {
+        if (errno == EINTR)
+          continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          break;
+
+        connection_destroy(server, c);
+        return;
+      }
+
+      if (received == 0)
+      {
+        /* Answer a final unterminated line before hanging up */
+        if (c->input_length > 0)
+        {
+          c->input[c->input_length] = '\0';
+          connection_respond(server, c, c->input);
+          c->input_length = 0;
+        }
+
+        c->closing = 1;
+        break;
+      }
+
+      c->input_length += received;
+      connection_process_input(server, c);
+
+      if (c->closing)
+        break;
+    }
+  }
+
+  if (connection_flush(c) != 0 || (c->closing && c->output_length == 0))
+  {
+    connection_destroy(server, c);
+    return;
+  }
+
+  uint32_t rearm = EPOLLONESHOT;
+  if (!c->closing && !connection_backlogged(c))
+    rearm |= EPOLLIN;
+  if (c->output_length > 0)
+    rearm |= EPOLLOUT;
+
+  server_arm(server, c->fd, c, rearm, EPOLL_CTL_MOD);
+}
+
+
+/* Worker thread body. Every worker waits on the same epoll set and
+ * services whichever descriptor becomes ready.
+ */
+
+static void *server_worker(void *arg)
+{
+  struct server *server = (struct server *) arg;
+
+  for(;;)
+  {
+    struct epoll_event event;
+    const int count = epoll_wait(server->epoll_fd, &event, 1, -1);
+
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      perror("epoll_wait");
+      break;
+    }
+
+    if (count == 0)
+      continue;
+
+    if (event.data.ptr == &shutdown_tag)
+      break;
+    else if (event.data.ptr == &listener_tag)
+      server_accept(server);
+    else
+      server_service(server, (struct connection *) event.data.ptr, event.events);
+  }
+
+  return NULL;
+}
+
+
+/* Serves ELIZA sessions over the Unix domain socket at socket_path
+ * until SIGINT or SIGTERM is received. Each connection is an
+ * independent session speaking a line-based protocol: the greeting is
+ * sent on connect and every input line is answered by exactly one
+ * line. The eliza state is shared read-only between worker_count
+ * worker threads. On SIGHUP the script is reloaded on this thread while
+ * the workers carry on; each turn uses whichever version was current
+ * when it started. Returns 0 on a clean shutdown.
+ */
+
+int server_run(struct reloadable_eliza *eliza, const char *socket_path, int worker_count)
+{
+  assert(eliza != NULL);
+  assert(socket_path != NULL);
+  assert(worker_count > 0);
+
+  struct server server;
+  server.eliza = eliza;
+  server.next_seed = 1;
+  server.connections = NULL;
+
+  server.listen_fd = server_listen(socket_path);
+  if (server.listen_fd < 0)
+    return -1;
+
+  if (pipe(server.shutdown_pipe) != 0)
+  {
+    perror("pipe");
+    close(server.listen_fd);
+    return -1;
+  }
+
+  server.epoll_fd = epoll_create1(0);
+  if (server.epoll_fd < 0)
+  {
+    perror("epoll_create1");
+    close(server.shutdown_pipe[0]);
+    close(server.shutdown_pipe[1]);
+    close(server.listen_fd);
+    return -1;
+  }
+
+  pthread_mutex_init(&server.lock, NULL);
+  server_arm(&server, server.listen_fd, &listener_tag, EPOLLIN | EPOLLONESHOT, EPOLL_CTL_ADD);
+  /* Level triggered and never drained, so it wakes every worker */
+  server_arm(&server, server.shutdown_pipe[0], &shutdown_tag, EPOLLIN, EPOLL_CTL_ADD);
+
+  /* Workers inherit this mask, leaving the signals to sigwait() below */
+  sigset_t signals, old_signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+  pthread_t *workers = malloc(worker_count * sizeof(pthread_t));
+  if (workers == NULL)
+  {
+    perror("server_run");
+    exit(EXIT_FAILURE);
+  }
+
+  int started = 0;
+  for(; started < worker_count; ++started)
+  {
+    if (pthread_create(&workers[started], NULL, &server_worker, &server) != 0)
+    {
+      fprintf(stderr, "Unable to start worker thread %d\n", started);
+      break;
+    }
+  }
+
+  if (started > 0)
+  {
+    fprintf(stderr, "Listening on %s with %d workers\n", socket_path, started);
+
+    int signal_number;
+    while (sigwait(&signals, &signal_number) == 0 && signal_number == SIGHUP)
+    {
+      if (reload_swap(eliza) == 0)
+        fprintf(stderr, "Reloaded script\n");
+      else
+        fprintf(stderr, "Reload failed, keeping the current script\n");
+    }
+  }
+
+  while (write(server.shutdown_pipe[1], "", 1) < 0 && errno == EINTR)
+    ;
+
+  for(int index = 0; index < started; ++index)
+    pthread_join(workers[index], NULL);
+
+  free(workers);
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+  while (server.connections != NULL)
+    connection_destroy(&server, server.connections);
+
+  pthread_mutex_destroy(&server.lock);
+  close(server.epoll_fd);
+  close(server.shutdown_pipe[0]);
+  close(server.shutdown_pipe[1]);
+  close(server.listen_fd);
+  unlink(socket_path);
+
+  return started > 0 ? 0 : -1;
+}
@@ -0,0 +1,13 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+struct reloadable_eliza;
+
+enum
+{
+  DEFAULT_WORKER_COUNT = 4
+};
+
+int server_run(struct reloadable_eliza *eliza, const char *socket_path, int worker_count);
+
+#endif
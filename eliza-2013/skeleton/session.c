@@ -0,0 +1,138 @@
+#include "session.h"
+#include "string_utils.h"
+#include "list.h"
+#include "map.h"
+#include "eliza_state.h"
+#include "rule.h"
+#include "profile.h"
+#include "scanner.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+static const char *no_match_key = "xnone";
+
+/* The context passed to collect_rules() while scanning a line */
+
+struct rule_search
+{
+  struct eliza_state *eliza;
+  const char *input;
+  struct rule_candidates *out;
+};
+
+static void collect_rules(void *context, const struct keyword_hit *hit);
+static int is_exit(struct eliza_state *eliza, struct arena *arena, const char *str);
+
+
+/* Scanner callback adding the rules for a keyword found in the input
+ * that apply to it. The context is a struct rule_search.
+ */
+
+static void collect_rules(void *context, const struct keyword_hit *hit)
+{
+  struct rule_search *search = (struct rule_search*) context;
+  find_keyword_rules(search->eliza, (struct list*) hit->value, search->input, search->out);
+}
+
+
+/* Returns true if the string is a token suggesting the user wants to
+ * exit the session.
+ *
+ */
+
+static int is_exit(struct eliza_state *eliza, struct arena *arena, const char *str)
+{
+  assert(eliza != NULL);
+  assert(str != NULL);
+
+  char* lowercase = arena_clone(arena, str);
+  make_lowercase(lowercase);
+
+  return map_contains(&eliza->quit_words, lowercase);
+}
+
+
+/* Initialises a session. The seed drives the random choice between
+ * equally good rules, so sessions started with the same seed hold the
+ * same conversation.
+ */
+
+void session_init(struct eliza_session *session, unsigned int seed)
+{
+  assert(session != NULL);
+
+  session->seed = seed;
+  arena_init(&session->arena, SESSION_ARENA_SIZE);
+}
+
+
+/* Frees the memory held by a session */
+
+void session_destroy(struct eliza_session *session)
+{
+  assert(session != NULL);
+
+  arena_destroy(&session->arena);
+}
+
+
+/* Computes ELIZA's response to a single line of user input. Returns
+ * SESSION_REPLY and assigns the reply to *out if a rule was applied;
+ * the reply belongs to the session and is valid until the next call.
+ * Otherwise returns SESSION_QUIT if the user asked to leave,
+ * SESSION_NO_RULE if no rule (not even the fallback) matched or
+ * SESSION_NO_REPLY if the chosen rule could not be applied.
+ *
+ * If profile is non-NULL, the time spent in each phase of the turn is
+ * added to it.
+ *
+ * The eliza state is only read, so any number of sessions may respond
+ * concurrently against the same state.
+ */
+
+int session_respond(struct eliza_session *session, struct eliza_state *eliza,
+  const char *line, struct turn_profile *profile, char **out)
+{
+  assert(session != NULL);
+  assert(eliza != NULL);
+  assert(line != NULL);
+  assert(out != NULL);
+
+  struct arena *arena = &session->arena;
+  arena_reset(arena);
+
+  if (is_exit(eliza, arena, line))
+    return SESSION_QUIT;
+
+  long long since = profile != NULL ? profile_clock() : 0;
+
+  char *input = rewrite_string(arena, &eliza->prereplace, line);
+  profile_mark(profile, PHASE_PREREPLACE, &since);
+
+  char *keywords = rewrite_string(arena, &eliza->synonyms, input);
+  profile_mark(profile, PHASE_TOKENIZE, &since);
+
+  struct rule_candidates applicable_rules;
+  rule_candidates_init(&applicable_rules, arena);
+
+  struct rule_search search = {eliza, input, &applicable_rules};
+  scanner_scan(&eliza->scanner, keywords, &collect_rules, &search);
+
+  if (applicable_rules.count == 0)
+    find_rules(eliza, no_match_key, input, &applicable_rules);
+
+  profile_mark(profile, PHASE_FIND_RULES, &since);
+
+  if (applicable_rules.count == 0)
+    return SESSION_NO_RULE;
+
+  struct rule *rule = choose_rule(&applicable_rules, &session->seed);
+  profile_mark(profile, PHASE_CHOOSE_RULE, &since);
+
+  if (rule_apply(eliza, rule, input, arena, profile, out) != 0)
+    return SESSION_NO_REPLY;
+
+  return SESSION_REPLY;
+}
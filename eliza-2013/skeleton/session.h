@@ -0,0 +1,41 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "fwd.h"
+#include "arena.h"
+
+struct turn_profile;
+
+enum
+{
+  MAX_INPUT_LENGTH = 256,
+  SESSION_ARENA_SIZE = 4096
+};
+
+enum
+{
+  SESSION_REPLY,
+  SESSION_NO_REPLY,
+  SESSION_NO_RULE,
+  SESSION_QUIT
+};
+
+/* The state belonging to a single conversation. Everything else
+ * (rules, maps and the script) lives in a struct eliza_state which is
+ * shared read-only between all sessions. All memory used by a turn
+ * comes from the session's arena, which is reset when the next turn
+ * starts.
+ */
+
+struct eliza_session
+{
+  unsigned int seed;
+  struct arena arena;
+};
+
+void session_init(struct eliza_session *session, unsigned int seed);
+void session_destroy(struct eliza_session *session);
+int session_respond(struct eliza_session *session, struct eliza_state *eliza,
+  const char *line, struct turn_profile *profile, char **out);
+
+#endif
@@ -0,0 +1,451 @@
+#include "snapshot.h"
+#include "eliza_state.h"
+#include "rule.h"
+#include "list.h"
+#include "map.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "ELIZASNP"
+
+enum
+{
+  SNAPSHOT_VERSION = 3,
+  SNAPSHOT_ALIGNMENT = 8,
+  INITIAL_OBJECT_CAPACITY = 256
+};
+
+struct snapshot_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t pointer_size;
+  uint32_t state_size;
+  uint32_t rule_size;
+  uint64_t length;
+  uint64_t state;
+  uint64_t relocations;
+  uint64_t relocation_count;
+};
+
+/* An entry in the table of objects already written to the image, used
+ * so that shared objects (rules are referenced by both the rule list
+ * and the keyword index) are written once.
+ */
+
+struct snapshot_object
+{
+  const void *object;
+  size_t offset;
+};
+
+struct snapshot_writer
+{
+  char *data;
+  size_t length;
+  size_t capacity;
+  uint64_t *relocations;
+  size_t relocation_count;
+  size_t relocation_capacity;
+  struct snapshot_object *objects;
+  size_t object_count;
+  size_t object_capacity;
+};
+
+static void *snapshot_grow(void *buffer, size_t *capacity, size_t needed, size_t element_size);
+static size_t snapshot_object_slot(struct snapshot_object *objects, size_t capacity, const void *object);
+static size_t snapshot_write_rule(struct snapshot_writer *w, void *value);
+static size_t snapshot_write_rule_list(struct snapshot_writer *w, void *value);
+static int snapshot_check(const char *base, size_t length);
+
+
+/* Grows a buffer of *capacity elements so it can hold at least 'needed'
+ * elements.
+ */
+
+static void *snapshot_grow(void *buffer, size_t *capacity, size_t needed, size_t element_size)
+{
+  if (needed <= *capacity)
+    return buffer;
+
+  size_t new_capacity = *capacity == 0 ? INITIAL_OBJECT_CAPACITY : *capacity;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  void *grown = realloc(buffer, new_capacity * element_size);
+  if (grown == NULL)
+  {
+    perror("snapshot_grow");
+    exit(EXIT_FAILURE);
+  }
+
+  *capacity = new_capacity;
+  return grown;
+}
+
+
+/* Reserves 'size' zeroed bytes in the image and returns their offset.
+ * Pointers returned by snapshot_at() are invalidated by this call.
+ */
+
+size_t snapshot_reserve(struct snapshot_writer *w, size_t size)
+{
+  const size_t offset = (w->length + SNAPSHOT_ALIGNMENT - 1) & ~(size_t) (SNAPSHOT_ALIGNMENT - 1);
+
+  w->data = snapshot_grow(w->data, &w->capacity, offset + size, 1);
+  memset(w->data + w->length, 0, offset + size - w->length);
+  w->length = offset + size;
+
+  return offset;
+}
+
+
+/* Returns the address of the image data at 'offset' */
+
+void *snapshot_at(struct snapshot_writer *w, size_t offset)
+{
+  assert(offset < w->length);
+  return w->data + offset;
+}
+
+
+/* Stores a pointer to the image offset 'target' in the pointer-sized
+ * field at offset 'at' and records it for relocation. A target of 0 is
+ * the NULL pointer, since offset 0 always holds the file header.
+ */
+
+void snapshot_set_pointer(struct snapshot_writer *w, size_t at, size_t target)
+{
+  assert(at + sizeof(void *) <= w->length);
+
+  const uintptr_t value = target;
+  memcpy(w->data + at, &value, sizeof(value));
+
+  if (target == 0)
+    return;
+
+  w->relocations = snapshot_grow(w->relocations, &w->relocation_capacity,
+    w->relocation_count + 1, sizeof(uint64_t));
+  w->relocations[w->relocation_count++] = at;
+}
+
+
+/* Writes a null-terminated string into the image and returns its
+ * offset, or 0 if str is NULL. Usable directly as a
+ * snapshot_value_writer for maps from strings to strings.
+ */
+
+size_t snapshot_write_string(struct snapshot_writer *w, void *str)
+{
+  if (str == NULL)
+    return 0;
+
+  const size_t length = strlen((const char *) str) + 1;
+  const size_t offset = snapshot_reserve(w, length);
+  memcpy(w->data + offset, str, length);
+
+  return offset;
+}
+
+
+/* Returns the slot of 'object' in an open addressed object table, or
+ * the empty slot where it belongs.
+ */
+
+static size_t snapshot_object_slot(struct snapshot_object *objects, size_t capacity, const void *object)
+{
+  size_t slot = (((uintptr_t) object >> 3) * 2654435761u) & (capacity - 1);
+
+  while (objects[slot].object != NULL && objects[slot].object != object)
+    slot = (slot + 1) & (capacity - 1);
+
+  return slot;
+}
+
+
+/* Records that 'object' has been written to the image at 'offset' */
+
+void snapshot_remember(struct snapshot_writer *w, const void *object, size_t offset)
+{
+  assert(object != NULL);
+
+  if (2 * (w->object_count + 1) > w->object_capacity)
+  {
+    const size_t old_capacity = w->object_capacity;
+    struct snapshot_object *old_objects = w->objects;
+
+    w->object_capacity *= 2;
+    w->objects = calloc(w->object_capacity, sizeof(struct snapshot_object));
+    if (w->objects == NULL)
+    {
+      perror("snapshot_remember");
+      exit(EXIT_FAILURE);
+    }
+
+    for(size_t index = 0; index < old_capacity; ++index)
+    {
+      if (old_objects[index].object != NULL)
+      {
+        const size_t slot = snapshot_object_slot(w->objects, w->object_capacity, old_objects[index].object);
+        w->objects[slot] = old_objects[index];
+      }
+    }
+
+    free(old_objects);
+  }
+
+  const size_t slot = snapshot_object_slot(w->objects, w->object_capacity, object);
+  if (w->objects[slot].object == NULL)
+    ++w->object_count;
+
+  w->objects[slot].object = object;
+  w->objects[slot].offset = offset;
+}
+
+
+/* Returns the offset at which 'object' was written, or 0 if it has not
+ * been written yet.
+ */
+
+size_t snapshot_find(struct snapshot_writer *w, const void *object)
+{
+  const size_t slot = snapshot_object_slot(w->objects, w->object_capacity, object);
+  return w->objects[slot].object == NULL ? 0 : w->objects[slot].offset;
+}
+
+
+/* Writes a struct rule into the image, once per rule */
+
+static size_t snapshot_write_rule(struct snapshot_writer *w, void *value)
+{
+  struct rule *rule = (struct rule *) value;
+
+  size_t at = snapshot_find(w, rule);
+  if (at != 0)
+    return at;
+
+  at = snapshot_reserve(w, sizeof(struct rule));
+  snapshot_remember(w, rule, at);
+
+  ((struct rule *) snapshot_at(w, at))->id = rule->id;
+  ((struct rule *) snapshot_at(w, at))->precedence = rule->precedence;
+  snapshot_set_pointer(w, at + offsetof(struct rule, key), snapshot_write_string(w, rule->key));
+  snapshot_set_pointer(w, at + offsetof(struct rule, decomp), snapshot_write_string(w, rule->decomp));
+  snapshot_set_pointer(w, at + offsetof(struct rule, reasmb), snapshot_write_string(w, rule->reasmb));
+  snapshot_set_pointer(w, at + offsetof(struct rule, pattern), snapshot_write_string(w, rule->pattern));
+  snapshot_set_pointer(w, at + offsetof(struct rule, target), snapshot_write_string(w, rule->target));
+
+  return at;
+}
+
+
+/* Writes one keyword index entry: a heap allocated list of rules */
+
+static size_t snapshot_write_rule_list(struct snapshot_writer *w, void *value)
+{
+  const size_t at = snapshot_reserve(w, sizeof(struct list));
+  list_snapshot((struct list *) value, w, at, &snapshot_write_rule);
+  return at;
+}
+
+
+/* Writes a snapshot of the parsed script held in eliza to the file at
+ * 'path'. The file is written beside its destination and renamed into
+ * place, so a concurrent loader never sees a partial snapshot. Returns
+ * 0 on success.
+ */
+
+int snapshot_save(struct eliza_state *eliza, const char *path)
+{
+  assert(eliza != NULL);
+  assert(path != NULL);
+
+  struct snapshot_writer w;
+  w.data = NULL;
+  w.length = 0;
+  w.capacity = 0;
+  w.relocations = NULL;
+  w.relocation_count = 0;
+  w.relocation_capacity = 0;
+  w.object_count = 0;
+  w.object_capacity = INITIAL_OBJECT_CAPACITY;
+  w.objects = calloc(w.object_capacity, sizeof(struct snapshot_object));
+  if (w.objects == NULL)
+  {
+    perror("snapshot_save");
+    exit(EXIT_FAILURE);
+  }
+
+  const size_t header = snapshot_reserve(&w, sizeof(struct snapshot_header));
+  const size_t state = snapshot_reserve(&w, sizeof(struct eliza_state));
+  assert(header == 0);
+
+  snapshot_set_pointer(&w, state + offsetof(struct eliza_state, begin), snapshot_write_string(&w, eliza->begin));
+  snapshot_set_pointer(&w, state + offsetof(struct eliza_state, end), snapshot_write_string(&w, eliza->end));
+  map_snapshot(&eliza->quit_words, &w, state + offsetof(struct eliza_state, quit_words), &snapshot_write_string);
+  map_snapshot(&eliza->prereplace, &w, state + offsetof(struct eliza_state, prereplace), &snapshot_write_string);
+  map_snapshot(&eliza->postreplace, &w, state + offsetof(struct eliza_state, postreplace), &snapshot_write_string);
+  map_snapshot(&eliza->synonyms, &w, state + offsetof(struct eliza_state, synonyms), &snapshot_write_string);
+  list_snapshot(&eliza->rules, &w, state + offsetof(struct eliza_state, rules), &snapshot_write_rule);
+  ((struct eliza_state *) snapshot_at(&w, state))->rule_count = eliza->rule_count;
+  map_snapshot(&eliza->keywords, &w, state + offsetof(struct eliza_state, keywords), &snapshot_write_rule_list);
+
+  const size_t relocations = snapshot_reserve(&w, w.relocation_count * sizeof(uint64_t));
+  if (w.relocation_count > 0)
+    memcpy(w.data + relocations, w.relocations, w.relocation_count * sizeof(uint64_t));
+
+  struct snapshot_header *h = (struct snapshot_header *) w.data;
+  memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+  h->version = SNAPSHOT_VERSION;
+  h->pointer_size = sizeof(void *);
+  h->state_size = sizeof(struct eliza_state);
+  h->rule_size = sizeof(struct rule);
+  h->length = w.length;
+  h->state = state;
+  h->relocations = relocations;
+  h->relocation_count = w.relocation_count;
+
+  const size_t temp_length = strlen(path) + sizeof(".tmp");
+  char *temp_path = malloc(temp_length);
+  if (temp_path == NULL)
+  {
+    perror("snapshot_save");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(temp_path, temp_length, "%s.tmp", path);
+
+  int result = -1;
+  FILE *file = fopen(temp_path, "wb");
+  if (file != NULL)
+  {
+    const int written = fwrite(w.data, 1, w.length, file) == w.length;
+    if (fclose(file) == 0 && written && rename(temp_path, path) == 0)
+      result = 0;
+    else
+      remove(temp_path);
+  }
+
+  if (result != 0)
+    perror("snapshot_save");
+
+  free(temp_path);
+  free(w.objects);
+  free(w.relocations);
+  free(w.data);
+  return result;
+}
+
+
+/* Validates a snapshot header and its relocation table. Returns 0 if
+ * the image was written by a compatible build and is self-consistent.
+ */
+
+static int snapshot_check(const char *base, size_t length)
+{
+  const struct snapshot_header *h = (const struct snapshot_header *) base;
+
+  if (length < sizeof(struct snapshot_header)
+      || memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0)
+    return -1;
+
+  if (h->version != SNAPSHOT_VERSION
+      || h->pointer_size != sizeof(void *)
+      || h->state_size != sizeof(struct eliza_state)
+      || h->rule_size != sizeof(struct rule)
+      || h->length != length)
+    return -1;
+
+  if (h->state > length - sizeof(struct eliza_state)
+      || h->relocations > length
+      || h->relocation_count > (length - h->relocations) / sizeof(uint64_t))
+    return -1;
+
+  const uint64_t *relocations = (const uint64_t *) (base + h->relocations);
+  for(uint64_t index = 0; index < h->relocation_count; ++index)
+  {
+    if (relocations[index] > length - sizeof(void *))
+      return -1;
+
+    uintptr_t target;
+    memcpy(&target, base + relocations[index], sizeof(target));
+    if (target >= length)
+      return -1;
+  }
+
+  return 0;
+}
+
+
+/* Loads the snapshot at 'path' into eliza, which must not have been
+ * initialised with eliza_init(). The file is mapped privately, its
+ * pointers are relocated to the mapping's address and the mapping is
+ * then made read-only. Rule patterns and the keyword scanner are built
+ * afresh by eliza_prepare(), since compiled regular expressions cannot
+ * be stored. The state must be released with
+ * eliza_destroy(). Returns 0 on success.
+ */
+
+int snapshot_load(struct eliza_state *eliza, const char *path)
+{
+  assert(eliza != NULL);
+  assert(path != NULL);
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("snapshot_load");
+    return -1;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0)
+  {
+    fprintf(stderr, "Unable to read snapshot: %s\n", path);
+    close(fd);
+    return -1;
+  }
+
+  const size_t length = info.st_size;
+  char *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (base == MAP_FAILED)
+  {
+    perror("snapshot_load");
+    return -1;
+  }
+
+  if (snapshot_check(base, length) != 0)
+  {
+    fprintf(stderr, "Invalid or incompatible snapshot: %s\n", path);
+    munmap(base, length);
+    return -1;
+  }
+
+  const struct snapshot_header *h = (const struct snapshot_header *) base;
+  const uint64_t *relocations = (const uint64_t *) (base + h->relocations);
+
+  for(uint64_t index = 0; index < h->relocation_count; ++index)
+  {
+    uintptr_t value;
+    memcpy(&value, base + relocations[index], sizeof(value));
+    value += (uintptr_t) base;
+    memcpy(base + relocations[index], &value, sizeof(value));
+  }
+
+  mprotect(base, length, PROT_READ);
+
+  *eliza = *(const struct eliza_state *) (base + h->state);
+  eliza->snapshot = base;
+  eliza->snapshot_length = length;
+  eliza_prepare(eliza);
+
+  return 0;
+}
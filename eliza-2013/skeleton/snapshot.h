@@ -0,0 +1,31 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "fwd.h"
+#include <stddef.h>
+
+/* A snapshot is a single relocatable image of a parsed struct
+ * eliza_state. Pointers inside the image are stored as offsets from
+ * the start of the file and listed in a relocation table, so loading
+ * is an mmap() followed by adding the mapping's base address to each
+ * listed pointer.
+ *
+ * Modules that own private node types (map.c, list.c) serialise them
+ * through the writer functions below.
+ */
+
+struct snapshot_writer;
+
+typedef size_t (*snapshot_value_writer)(struct snapshot_writer *w, void *value);
+
+size_t snapshot_reserve(struct snapshot_writer *w, size_t size);
+void *snapshot_at(struct snapshot_writer *w, size_t offset);
+void snapshot_set_pointer(struct snapshot_writer *w, size_t at, size_t target);
+size_t snapshot_write_string(struct snapshot_writer *w, void *str);
+void snapshot_remember(struct snapshot_writer *w, const void *object, size_t offset);
+size_t snapshot_find(struct snapshot_writer *w, const void *object);
+
+int snapshot_save(struct eliza_state *eliza, const char *path);
+int snapshot_load(struct eliza_state *eliza, const char *path);
+
+#endif
@@ -1,5 +1,6 @@
 #include "string_utils.h"
 #include "map.h"
+#include "arena.h"
 #include <stddef.h>
 #include <assert.h>
 #include <string.h>
@@ -78,70 +79,108 @@ void make_lowercase(char *str)
 }
 
 
-/* Given an input string, return the number of tokens, and a table of
- * tokens in *tokens. The input string is damaged by this process. The
- * returned table should be freed after use.
- */
+/* Returns a non-zero value if c separates tokens */
 
-int tokenize(char ***tokens, char* input)
+static int is_separator(const char c)
 {
-  assert(input != NULL);
+  return c == ' ' || c == '.' || c == '?' || c == '\n';
+}
+
 
+/* Splits input into tokens, storing a pointer to each in output and
+ * terminating each with '\0'. If output is NULL the tokens are only
+ * counted and input is left intact. Returns the number of tokens.
+ */
+
+static int split_tokens(char *input, char **output)
+{
   int token_count = 0;
   int middle_of_word = 0;
-  char **output = malloc(0);
-  assert(output != NULL);
 
-  while(*input != '\0')
+  for(; *input != '\0'; ++input)
   {
-    if (*input == ' ' || *input == '.' || *input == '?' || *input == '\n')
+    if (is_separator(*input))
     {
-      *input = '\0';
+      if (output != NULL)
+        *input = '\0';
+
       middle_of_word = 0;
     }
     else if (!middle_of_word)
     {
+      if (output != NULL)
+        output[token_count] = input;
+
       ++token_count;
-      output = realloc(output, token_count * sizeof(char*));
-      assert(output != NULL);
-      output[token_count - 1] = input;
       middle_of_word = 1;
     }
-
-    ++input;
   }
+
+  return token_count;
+}
+
+
+/* Given an input string, return the number of tokens, and a table of
+ * tokens in *tokens. The input string is damaged by this process. The
+ * returned table should be freed after use.
+ */
+
+int tokenize(char ***tokens, char* input)
+{
+  assert(input != NULL);
+
+  const int token_count = split_tokens(input, NULL);
+  char **output = malloc((token_count + 1) * sizeof(char*));
+  assert(output != NULL);
+
+  split_tokens(input, output);
+  *tokens = output;
+  return token_count;
+}
+
+
+/* As tokenize(), but the table of tokens is allocated in the arena */
+
+int tokenize_in(struct arena *arena, char ***tokens, char* input)
+{
+  assert(arena != NULL);
+  assert(input != NULL);
+
+  const int token_count = split_tokens(input, NULL);
+  char **output = arena_alloc(arena, token_count * sizeof(char*));
+
+  split_tokens(input, output);
   *tokens = output;
   return token_count;
 }
 
 
 /* Rewrites the supplied string, using the mapping from strings to
- * strings in substitutions. The returned string should be freed after
- * use.
+ * strings in substitutions. The returned string is allocated in the
+ * arena.
  */
 
-char *rewrite_string(struct map *substitutions, const char* const_input)
+char *rewrite_string(struct arena *arena, struct map *substitutions, const char* const_input)
 {
-  char *const input = clone(const_input);
+  char *const input = arena_clone(arena, const_input);
   char **tokens;
-  char *result = empty_string();
 
-  const int token_count = tokenize(&tokens, input);
+  const int token_count = tokenize_in(arena, &tokens, input);
+  char *result = arena_clone(arena, "");
+
   for(int index = 0; index < token_count; ++index)
   {
     make_lowercase(tokens[index]);
     char *replacement = (char *) map_lookup(substitutions, tokens[index]);
 
     if (replacement == NULL)
-      result = push_string(result, tokens[index]);
+      result = arena_append(arena, result, tokens[index]);
     else
-      result = push_string(result, replacement);
+      result = arena_append(arena, result, replacement);
 
     if (index + 1 < token_count)
-      result = push_string(result, " ");
+      result = arena_append(arena, result, " ");
   }
 
-  free(input);
-  free(tokens);
   return result;
 }
@@ -2,13 +2,15 @@
 #define STRING_UTILS_H
 
 struct map;
+struct arena;
 
 void trim_newline(char *str);
-char *rewrite_string(struct map *substitutions, const char* const_input);
+char *rewrite_string(struct arena *arena, struct map *substitutions, const char* const_input);
 char *empty_string(void);
 char *clone(const char *str);
 void make_lowercase(char *str);
 int tokenize(char ***tokens, char* input);
+int tokenize_in(struct arena *arena, char ***tokens, char* input);
 char *push_string(char *current, const char *append);
 
 #endif
@@ -1,94 +1,156 @@
 #include "binaryheap.h"
+#include "dheap.h"
 #include <assert.h>
 #include <string.h>
 
+/* The heap functions below are thin wrappers over the d-ary engine in
+ * dheap.c, run with arity 2 on the array of node pointers so that the
+ * layout matches parent(), left_child() and right_child(). Only the
+ * pointers move; the nodes themselves are never copied. */
+#define BINARY_ARITY 2
+
+/* Orders node pointers by key, then by position so that equal keys
+ * keep their original order once sorted */
+static int compare_nodes(const void *a, const void *b)
+{
+    const node_heap *node1 = *(node_heap * const *) a;
+    const node_heap *node2 = *(node_heap * const *) b;
+
+    const int order = strcmp(node1->key, node2->key);
+    if (order != 0)
+        return order;
+
+    return (node1->position > node2->position) - (node1->position < node2->position);
+}
+
+static void node_dheap(struct dheap *heap, node_heap **nodes)
+{
+    dheap_init(heap, nodes, sizeof(node_heap *), BINARY_ARITY, &compare_nodes);
+}
 
 
 /*allocate memory in the heap for a node_heap type element and returns a pointer to the new node_heap*/
 
 node_heap *allocate_node_heap(void)
 {
-  //TO DO
-   return NULL;
+    node_heap *node = malloc(sizeof(node_heap));
+    if (node == NULL) {
+        perror("allocate_node_heap");
+        exit(EXIT_FAILURE);
+    }
+
+    node->key = NULL;
+    node->position = 0;
+    return node;
 }
 
 /*initialise the heap array elements*/
 
 void initial_heap(node_heap **heap,char* sequence)
 {
-    //TO DO
+    assert(heap != NULL);
+    assert(sequence != NULL);
+
+    for (int index = 0; sequence[index] != '\0'; ++index) {
+        node_heap *node = allocate_node_heap();
+
+        node->key = malloc(2);
+        if (node->key == NULL) {
+            perror("initial_heap");
+            exit(EXIT_FAILURE);
+        }
+
+        node->key[0] = sequence[index];
+        node->key[1] = '\0';
+        node->position = index;
+        heap[index] = node;
+    }
 }
 
 
 /*print every element of the heap array*/
 void print_elem_heap(node_heap **heap, int length)
 {
-    //TO DO
+    for (int index = 0; index < length; ++index)
+        printf("%s ", heap[index]->key);
+
+    printf("\n");
 }
 
 /* returns the index in the heap array where the parent is allocated for the index passed as argument*/
 
 int parent(int index)
 {
-   //TO DO
-    return 0;
+    return (index - 1) / BINARY_ARITY;
 }
 
 /* returns the index in the heap array where the left child is allocated for the index passed as argument*/
 
 int left_child(int index)
 {
-    //TO DO
-    return 0;
+    return BINARY_ARITY * index + 1;
 }
 
 /* returns the index in the heap array where the right child is allocated for the index passed as argument*/
 
 int right_child(int index)
 {
-    //TO DO
-    return 0;
+    return BINARY_ARITY * index + 2;
 }
 
 /* exchange node_heap node1 to node_heap node2*/ 
 
 void swap(node_heap *node1, node_heap *node2)
 {
-    //TO DO
+    node_heap temp = *node1;
+    *node1 = *node2;
+    *node2 = temp;
 }
 
 /*Moves down the value of the heap[current] so the subtree rooted at index "current" satisfies with the max-heap property*/ 
 
 void max_heapify(node_heap **heap, int current, int heap_size)
 {
-    //TO DO
+    struct dheap dheap;
+    node_dheap(&dheap, heap);
+    dheap_sift_down(&dheap, current, heap_size);
 }
 
 /*it orders the heap so the ordered heap complies the max-heap property*/
 
 void build_max_heap(node_heap **heap, int heap_size)
 {
-    //TO DO
+    struct dheap dheap;
+    node_dheap(&dheap, heap);
+    dheap_build(&dheap, heap_size);
 }
 
 /*starting from a max-heap ordered array, it moves the largest item from the heap and it into the array position left as the heap shrinks*/
 
 void heapsort(node_heap **heap, int length)
 {
-   //TO DO
-    
+    struct dheap dheap;
+    node_dheap(&dheap, heap);
+    dheap_sort_heap(&dheap, length);
 }
 
 /*free the memory allocated by a node_heap type element in the heap*/
 
 void free_node(node_heap *node)
 {
-    //TO DO
+    if (node == NULL)
+        return;
+
+    free(node->key);
+    free(node);
 }
 
 /*free the memory allocated in the heap array*/
 
 void free_heap(node_heap **heap, int length)
 {
-    //TO DO
-}
\ No newline at end of file
+    for (int index = 0; index < length; ++index)
+        free_node(heap[index]);
+
+    free(heap);
+}
@@ -0,0 +1,140 @@
+#include "dheap.h"
+#include "sortcount.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Copies one element. The common sizes get a fixed-size memcpy, which
+ * the compiler turns into a single move. */
+static void copy_element(void *dst, const void *src, size_t size)
+{
+    COUNT_MOVE();
+
+    if (size == sizeof(uint64_t))
+        memcpy(dst, src, sizeof(uint64_t));
+    else if (size == sizeof(uint32_t))
+        memcpy(dst, src, sizeof(uint32_t));
+    else
+        memcpy(dst, src, size);
+}
+
+static int compare(const struct dheap *heap, const void *a, const void *b)
+{
+    COUNT_COMPARISON();
+    return heap->compare(a, b);
+}
+
+static char *element(const struct dheap *heap, size_t index)
+{
+    return (char *) heap->base + index * heap->size;
+}
+
+void dheap_init(struct dheap *heap, void *base, size_t size, unsigned arity, dheap_compare compare)
+{
+    assert(heap != NULL);
+    assert(size > 0);
+    assert(arity >= 2);
+    assert(compare != NULL);
+
+    heap->base = base;
+    heap->size = size;
+    heap->arity = arity;
+    heap->compare = compare;
+}
+
+/* Floyd's bottom-up sift-down. The hole left by the element is first
+ * walked all the way down to a leaf along the path of largest children,
+ * which costs arity-1 comparisons per level instead of arity. The
+ * element is then dropped into the hole and sifted back up, which is
+ * usually only a level or two since it came from the bottom. */
+void dheap_sift_down(const struct dheap *heap, size_t index, size_t count)
+{
+    assert(heap != NULL);
+    assert(index < count);
+
+    const size_t size = heap->size;
+    const size_t arity = heap->arity;
+    unsigned char saved[size];
+    copy_element(saved, element(heap, index), size);
+
+    size_t hole = index;
+    for (;;) {
+        const size_t first = hole * arity + 1;
+        if (first >= count)
+            break;
+
+        const size_t last = first + arity < count ? first + arity : count;
+        size_t largest = first;
+        for (size_t child = first + 1; child < last; ++child) {
+            if (compare(heap, element(heap, child), element(heap, largest)) > 0)
+                largest = child;
+        }
+
+        copy_element(element(heap, hole), element(heap, largest), size);
+        hole = largest;
+    }
+
+    while (hole > index) {
+        const size_t up = (hole - 1) / arity;
+        if (compare(heap, saved, element(heap, up)) <= 0)
+            break;
+
+        copy_element(element(heap, hole), element(heap, up), size);
+        hole = up;
+    }
+
+    copy_element(element(heap, hole), saved, size);
+}
+
+void dheap_sift_up(const struct dheap *heap, size_t index)
+{
+    assert(heap != NULL);
+
+    const size_t size = heap->size;
+    unsigned char saved[size];
+    copy_element(saved, element(heap, index), size);
+
+    while (index > 0) {
+        const size_t up = (index - 1) / heap->arity;
+        if (compare(heap, saved, element(heap, up)) <= 0)
+            break;
+
+        copy_element(element(heap, index), element(heap, up), size);
+        index = up;
+    }
+
+    copy_element(element(heap, index), saved, size);
+}
+
+void dheap_build(const struct dheap *heap, size_t count)
+{
+    assert(heap != NULL);
+
+    if (count < 2)
+        return;
+
+    for (size_t index = (count - 2) / heap->arity + 1; index-- > 0; )
+        dheap_sift_down(heap, index, count);
+}
+
+void dheap_sort_heap(const struct dheap *heap, size_t count)
+{
+    assert(heap != NULL);
+
+    const size_t size = heap->size;
+    unsigned char top[size];
+
+    while (count > 1) {
+        --count;
+        copy_element(top, element(heap, 0), size);
+        copy_element(element(heap, 0), element(heap, count), size);
+        copy_element(element(heap, count), top, size);
+        dheap_sift_down(heap, 0, count);
+    }
+}
+
+void dheap_sort(const struct dheap *heap, size_t count)
+{
+    dheap_build(heap, count);
+    dheap_sort_heap(heap, count);
+}
@@ -0,0 +1,42 @@
+#ifndef _DHEAP_H_
+#define _DHEAP_H_
+
+#include <stddef.h>
+
+/* A d-ary max-heap engine over a contiguous array of fixed-size
+ * elements, in the style of qsort(). The children of index i are
+ * i*arity+1 .. i*arity+arity, so arity 2 gives the usual binary heap
+ * and arity 4 or 8 keeps the children of a node in one or two cache
+ * lines. The element for which compare() is largest is at the root.
+ */
+
+typedef int (*dheap_compare)(const void *a, const void *b);
+
+struct dheap
+{
+    void *base;
+    size_t size;
+    unsigned arity;
+    dheap_compare compare;
+};
+
+void dheap_init(struct dheap *heap, void *base, size_t size, unsigned arity, dheap_compare compare);
+
+/* Moves the element at index down until the subtree rooted there, of
+ * the first count elements, is a max-heap. */
+void dheap_sift_down(const struct dheap *heap, size_t index, size_t count);
+
+/* Moves the element at index up until it is no larger than its parent */
+void dheap_sift_up(const struct dheap *heap, size_t index);
+
+/* Orders the first count elements as a max-heap */
+void dheap_build(const struct dheap *heap, size_t count);
+
+/* Sorts the first count elements, which must form a max-heap, into
+ * ascending order */
+void dheap_sort_heap(const struct dheap *heap, size_t count);
+
+/* Sorts the first count elements into ascending order */
+void dheap_sort(const struct dheap *heap, size_t count);
+
+#endif
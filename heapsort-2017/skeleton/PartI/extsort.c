@@ -0,0 +1,412 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dheap.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* Sorts a file of unsigned 64-bit keys, one decimal key per line, that
+ * may be much larger than memory.
+ *
+ * The input is read in runs that fit the memory budget. Each run is
+ * heapsorted on a worker thread and spilled to a temporary file as raw
+ * binary keys, while the main thread reads the next run. The runs are
+ * then merged by a k-way merge: a min-heap holds the head of each run,
+ * and the smallest head is output and replaced by the next key of its
+ * run. Whenever as many runs are waiting as can be merged at once, the
+ * newer half of them is merged into one longer run, so that open runs
+ * never exceed the fan-in. All file I/O goes through large buffers. */
+
+#define DEFAULT_MEMORY_MB 256
+#define DEFAULT_THREADS 4
+#define MAX_FAN_IN 128
+#define MIN_FAN_IN 3
+/* Descriptors besides the runs: standard streams, input, output, and a
+ * merge's output run */
+#define RESERVED_FILES 8
+#define IO_BUFFER_SIZE (1 << 20)
+#define RUN_BUFFER_SIZE (1 << 18)
+#define SORT_ARITY 4
+
+/* A sorted run spilled to a temporary file */
+typedef struct run_t {
+    FILE *file;
+    size_t count;
+} run;
+
+/* A run being sorted and spilled by a worker thread */
+typedef struct sorter_t {
+    pthread_t thread;
+    int busy;
+    uint64_t *keys;
+    size_t count;
+    run out;
+    const char *tmpdir;
+} sorter;
+
+/* A run being read by the merge, and its current head */
+typedef struct merge_source_t {
+    uint64_t head;
+    FILE *file;
+    size_t remaining;
+} merge_source;
+
+static void *xmalloc(size_t size)
+{
+    void *memory = malloc(size);
+    if (memory == NULL) {
+        perror("extsort");
+        exit(EXIT_FAILURE);
+    }
+
+    return memory;
+}
+
+/* Opens an anonymous temporary file in dir, removed once closed. Runs
+ * get smaller buffers than the input and output since up to MAX_FAN_IN
+ * of them are open at once during a merge. */
+static FILE *temporary_file(const char *dir)
+{
+    char *path = xmalloc(strlen(dir) + sizeof("/extsort.XXXXXX"));
+    sprintf(path, "%s/extsort.XXXXXX", dir);
+
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    unlink(path);
+    free(path);
+
+    FILE *file = fdopen(fd, "w+b");
+    if (file == NULL) {
+        perror("fdopen");
+        exit(EXIT_FAILURE);
+    }
+
+    setvbuf(file, NULL, _IOFBF, RUN_BUFFER_SIZE);
+    return file;
+}
+
+static void write_keys(FILE *file, const uint64_t *keys, size_t count)
+{
+    if (fwrite(keys, sizeof(uint64_t), count, file) != count) {
+        perror("extsort: write");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    const uint64_t key1 = *(const uint64_t *) a;
+    const uint64_t key2 = *(const uint64_t *) b;
+
+    return (key1 > key2) - (key1 < key2);
+}
+
+/* Orders merge sources so the smallest head is at the top of the max-heap engine */
+static int compare_sources(const void *a, const void *b)
+{
+    return compare_keys(&((const merge_source *) b)->head, &((const merge_source *) a)->head);
+}
+
+/* Worker thread body: heapsorts a run and spills it */
+static void *sort_run(void *arg)
+{
+    sorter *s = arg;
+
+    struct dheap heap;
+    dheap_init(&heap, s->keys, sizeof(uint64_t), SORT_ARITY, &compare_keys);
+    dheap_sort(&heap, s->count);
+
+    s->out.file = temporary_file(s->tmpdir);
+    s->out.count = s->count;
+    write_keys(s->out.file, s->keys, s->count);
+
+    return NULL;
+}
+
+/* Reads up to capacity keys from a text stream. Keys are runs of
+ * digits; anything else separates them. Returns the number read, and
+ * exits on a key too large for 64 bits rather than sort a wrong one. */
+static size_t read_keys(FILE *in, uint64_t *keys, size_t capacity)
+{
+    size_t count = 0;
+    int c = getc_unlocked(in);
+
+    while (count < capacity && c != EOF) {
+        while (c != EOF && (c < '0' || c > '9'))
+            c = getc_unlocked(in);
+
+        if (c == EOF)
+            break;
+
+        uint64_t key = 0;
+        for (; c >= '0' && c <= '9'; c = getc_unlocked(in)) {
+            const unsigned digit = c - '0';
+            if (key > (UINT64_MAX - digit) / 10) {
+                fprintf(stderr, "extsort: key exceeds %" PRIu64 "\n", UINT64_MAX);
+                exit(EXIT_FAILURE);
+            }
+            key = key * 10 + digit;
+        }
+
+        keys[count++] = key;
+    }
+
+    if (c != EOF)
+        ungetc(c, in);
+
+    return count;
+}
+
+/* Writes a key in decimal followed by a newline */
+static void print_key(FILE *out, uint64_t key)
+{
+    char digits[24];
+    int length = 0;
+
+    do {
+        digits[length++] = '0' + key % 10;
+        key /= 10;
+    } while (key != 0);
+
+    while (length > 0)
+        putc_unlocked(digits[--length], out);
+
+    putc_unlocked('\n', out);
+}
+
+static void append_run(run **runs, size_t *count, size_t *capacity, run r)
+{
+    if (*count == *capacity) {
+        *capacity = *capacity == 0 ? 16 : 2 * *capacity;
+        *runs = realloc(*runs, *capacity * sizeof(run));
+        if (*runs == NULL) {
+            perror("extsort");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    (*runs)[(*count)++] = r;
+}
+
+/* Reads the next key of a source into its head. Returns 0 once the
+ * source is exhausted. */
+static int advance(merge_source *source)
+{
+    if (source->remaining == 0)
+        return 0;
+
+    if (fread(&source->head, sizeof(uint64_t), 1, source->file) != 1) {
+        perror("extsort: read");
+        exit(EXIT_FAILURE);
+    }
+
+    --source->remaining;
+    return 1;
+}
+
+/* Merges count runs into one. Keys are written to out as binary if
+ * text is 0, as decimal lines otherwise. The input runs are closed. */
+static void merge_runs(run *runs, size_t count, FILE *out, int text)
+{
+    merge_source *sources = xmalloc(count * sizeof(merge_source));
+    size_t live = 0;
+
+    for (size_t index = 0; index < count; ++index) {
+        rewind(runs[index].file);
+
+        merge_source *source = &sources[live];
+        source->file = runs[index].file;
+        source->remaining = runs[index].count;
+        if (advance(source))
+            ++live;
+    }
+
+    struct dheap heap;
+    dheap_init(&heap, sources, sizeof(merge_source), 2, &compare_sources);
+    dheap_build(&heap, live);
+
+    while (live > 0) {
+        if (text)
+            print_key(out, sources[0].head);
+        else
+            write_keys(out, &sources[0].head, 1);
+
+        if (!advance(&sources[0]))
+            sources[0] = sources[--live];
+
+        if (live > 0)
+            dheap_sift_down(&heap, 0, live);
+    }
+
+    for (size_t index = 0; index < count; ++index)
+        fclose(runs[index].file);
+
+    free(sources);
+}
+
+/* Merges the newer half of count runs into one longer run. Returns the
+ * new number of runs. Done whenever fan_in runs are waiting, this merges
+ * each key about log(runs) / log(fan_in / 2) times. */
+static size_t merge_newest(run *runs, size_t count, const char *tmpdir)
+{
+    const size_t start = count / 2;
+    run r = { temporary_file(tmpdir), 0 };
+
+    for (size_t index = start; index < count; ++index)
+        r.count += runs[index].count;
+
+    merge_runs(runs + start, count - start, r.file, 0);
+    runs[start] = r;
+    return start + 1;
+}
+
+/* Splits the input into sorted runs, sorting up to thread_count runs
+ * at once, and keeps fewer than fan_in of them. Returns the runs and
+ * stores their number in *run_count. */
+static run *make_runs(FILE *in, size_t run_keys, int thread_count, size_t fan_in, const char *tmpdir, size_t *run_count)
+{
+    sorter *sorters = xmalloc(thread_count * sizeof(sorter));
+    for (int index = 0; index < thread_count; ++index) {
+        sorters[index].busy = 0;
+        sorters[index].keys = xmalloc(run_keys * sizeof(uint64_t));
+        sorters[index].tmpdir = tmpdir;
+    }
+
+    run *runs = NULL;
+    size_t capacity = 0;
+    *run_count = 0;
+
+    for (int next = 0; ; next = (next + 1) % thread_count) {
+        sorter *s = &sorters[next];
+
+        if (s->busy) {
+            pthread_join(s->thread, NULL);
+            append_run(&runs, run_count, &capacity, s->out);
+            s->busy = 0;
+
+            if (*run_count == fan_in)
+                *run_count = merge_newest(runs, *run_count, tmpdir);
+        }
+
+        s->count = read_keys(in, s->keys, run_keys);
+        if (s->count == 0)
+            break;
+
+        if (pthread_create(&s->thread, NULL, &sort_run, s) != 0) {
+            fprintf(stderr, "extsort: unable to start sorting thread\n");
+            exit(EXIT_FAILURE);
+        }
+        s->busy = 1;
+    }
+
+    /* Collect the remaining runs in the order they were read */
+    for (int index = 0; index < thread_count; ++index) {
+        sorter *s = &sorters[index];
+        if (s->busy) {
+            pthread_join(s->thread, NULL);
+            append_run(&runs, run_count, &capacity, s->out);
+
+            if (*run_count == fan_in)
+                *run_count = merge_newest(runs, *run_count, tmpdir);
+        }
+        free(s->keys);
+    }
+
+    free(sorters);
+    return runs;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-m megabytes] [-t threads] [-T tmpdir] [input [output]]\n", program);
+    fprintf(stderr, "  -m megabytes  memory for in-memory runs (default %d)\n", DEFAULT_MEMORY_MB);
+    fprintf(stderr, "  -t threads    runs sorted in parallel (default %d)\n", DEFAULT_THREADS);
+    fprintf(stderr, "  -T tmpdir     directory for spilled runs (default $TMPDIR or /tmp)\n");
+}
+
+int main(int argc, char **argv){
+
+    long memory_mb = DEFAULT_MEMORY_MB;
+    int thread_count = DEFAULT_THREADS;
+    const char *tmpdir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+
+    int option;
+    while ((option = getopt(argc, argv, "m:t:T:")) != -1) {
+        switch (option) {
+            case 'm':
+                memory_mb = atol(optarg);
+                break;
+            case 't':
+                thread_count = atoi(optarg);
+                break;
+            case 'T':
+                tmpdir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (memory_mb <= 0 || thread_count <= 0 || argc - optind > 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *in = stdin;
+    if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = stdout;
+    if (optind + 1 < argc && (out = fopen(argv[optind + 1], "w")) == NULL) {
+        perror(argv[optind + 1]);
+        return EXIT_FAILURE;
+    }
+
+    /* Every sorter may hold a spilled run besides the fan-in */
+    size_t fan_in = MAX_FAN_IN;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+        && limit.rlim_cur < fan_in + thread_count + RESERVED_FILES) {
+        fan_in = limit.rlim_cur > (rlim_t) thread_count + RESERVED_FILES
+            ? limit.rlim_cur - thread_count - RESERVED_FILES : 0;
+    }
+
+    if (fan_in < MIN_FAN_IN) {
+        fprintf(stderr, "extsort: too few file descriptors for %d threads\n", thread_count);
+        return EXIT_FAILURE;
+    }
+
+    setvbuf(in, NULL, _IOFBF, IO_BUFFER_SIZE);
+    setvbuf(out, NULL, _IOFBF, IO_BUFFER_SIZE);
+
+    size_t run_keys = (size_t) memory_mb * 1024 * 1024 / sizeof(uint64_t) / thread_count;
+    if (run_keys == 0)
+        run_keys = 1;
+
+    size_t run_count;
+    run *runs = make_runs(in, run_keys, thread_count, fan_in, tmpdir, &run_count);
+    merge_runs(runs, run_count, out, 1);
+    free(runs);
+
+    if (in != stdin)
+        fclose(in);
+
+    if (fclose(out) != 0) {
+        perror("extsort: output");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
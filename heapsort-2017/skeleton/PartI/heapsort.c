@@ -1,8 +1,45 @@
 #include "binaryheap.h"
+#include "keysort.h"
+#include <string.h>
 
 
 int main(int argc, char **argv){
-    
- //TO DO
- return EXIT_SUCCESS;
-}
\ No newline at end of file
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <sequence>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char *sequence = argv[1];
+    const int length = strlen(sequence);
+
+    node_heap **heap = malloc((2 * length + 1) * sizeof(node_heap *));
+    if (heap == NULL) {
+        perror("main");
+        return EXIT_FAILURE;
+    }
+
+    initial_heap(heap, sequence);
+    printf("Initial:  ");
+    print_elem_heap(heap, length);
+
+    build_max_heap(heap, length);
+    printf("Max-heap: ");
+    print_elem_heap(heap, length);
+
+    heapsort(heap, length);
+    printf("Sorted:   ");
+    print_elem_heap(heap, length);
+
+    /* Single-character keys take the counting sort path */
+    initial_heap(heap + length, sequence);
+    sort_nodes(heap + length, length);
+    printf("Counted:  ");
+    print_elem_heap(heap + length, length);
+
+    for (int index = 0; index < length; ++index)
+        free_node(heap[length + index]);
+
+    free_heap(heap, length);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+#include "keysort.h"
+#include "sortcount.h"
+#include <assert.h>
+#include <string.h>
+
+#define RADIX_BITS 8
+#define RADIX_BINS (1 << RADIX_BITS)
+
+/* Fewer keys than this are insertion sorted, as no pass over bins pays */
+#define INSERTION_SORT_COUNT 16
+
+static void *keysort_alloc(size_t size)
+{
+    void *memory = malloc(size);
+    if (memory == NULL) {
+        perror("keysort");
+        exit(EXIT_FAILURE);
+    }
+
+    return memory;
+}
+
+/* Counting sort of keys known to lie in [low, low + range) */
+static void counting_sort_range(uint64_t *keys, size_t count, uint64_t low, size_t range)
+{
+    size_t *counts = calloc(range, sizeof(size_t));
+    if (counts == NULL) {
+        perror("keysort");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t index = 0; index < count; ++index)
+        ++counts[keys[index] - low];
+
+    uint64_t *out = keys;
+    for (size_t value = 0; value < range; ++value) {
+        for (size_t repeat = counts[value]; repeat > 0; --repeat)
+            *out++ = low + value;
+    }
+
+    COUNT_MOVES(count);
+
+    free(counts);
+}
+
+
+/*sort bytes into ascending order with a 256-bin histogram*/
+
+void counting_sort_bytes(unsigned char *keys, size_t count)
+{
+    size_t counts[256] = { 0 };
+
+    for (size_t index = 0; index < count; ++index)
+        ++counts[keys[index]];
+
+    for (int value = 0; value < 256; ++value) {
+        memset(keys, value, counts[value]);
+        keys += counts[value];
+    }
+
+    COUNT_MOVES(count);
+}
+
+/*sort keys into ascending order with an LSD radix sort*/
+
+void radix_sort(uint64_t *keys, size_t count, uint64_t *scratch)
+{
+    assert(keys != NULL || count == 0);
+
+    /* All the histograms are taken in one pass over the input */
+    size_t counts[sizeof(uint64_t)][RADIX_BINS];
+    memset(counts, 0, sizeof(counts));
+
+    for (size_t index = 0; index < count; ++index) {
+        const uint64_t key = keys[index];
+        for (size_t digit = 0; digit < sizeof(uint64_t); ++digit)
+            ++counts[digit][(key >> (digit * RADIX_BITS)) & (RADIX_BINS - 1)];
+    }
+
+    uint64_t *from = keys, *to = scratch;
+    for (size_t digit = 0; digit < sizeof(uint64_t); ++digit) {
+        const unsigned shift = digit * RADIX_BITS;
+        size_t *digit_counts = counts[digit];
+
+        /* A byte that is the same in every key does not reorder anything */
+        if (count == 0 || digit_counts[(from[0] >> shift) & (RADIX_BINS - 1)] == count)
+            continue;
+
+        size_t offset = 0;
+        for (int bin = 0; bin < RADIX_BINS; ++bin) {
+            const size_t bin_count = digit_counts[bin];
+            digit_counts[bin] = offset;
+            offset += bin_count;
+        }
+
+        for (size_t index = 0; index < count; ++index)
+            to[digit_counts[(from[index] >> shift) & (RADIX_BINS - 1)]++] = from[index];
+
+        COUNT_MOVES(count);
+
+        uint64_t *temp = from;
+        from = to;
+        to = temp;
+    }
+
+    if (from != keys) {
+        memcpy(keys, from, count * sizeof(uint64_t));
+        COUNT_MOVES(count);
+    }
+}
+
+static void insertion_sort(uint64_t *keys, size_t count)
+{
+    for (size_t index = 1; index < count; ++index) {
+        const uint64_t key = keys[index];
+        size_t hole = index;
+
+        for (; hole > 0 && (COUNT_COMPARISON(), key < keys[hole - 1]); --hole)
+            keys[hole] = keys[hole - 1];
+
+        keys[hole] = key;
+        COUNT_MOVES(index - hole + 1);
+    }
+}
+
+/*sort keys into ascending order, choosing the sort by the count and range of the keys*/
+
+void sort_keys(uint64_t *keys, size_t count)
+{
+    if (count < INSERTION_SORT_COUNT) {
+        insertion_sort(keys, count);
+        return;
+    }
+
+    uint64_t low = keys[0], high = keys[0];
+    for (size_t index = 1; index < count; ++index) {
+        if (keys[index] < low)
+            low = keys[index];
+        if (keys[index] > high)
+            high = keys[index];
+    }
+
+    /* Counting sort only while its bins cost no more than a radix pass */
+    const uint64_t span = high - low;
+    if (span < COUNTING_SORT_RANGE && span < 2 * count + RADIX_BINS) {
+        counting_sort_range(keys, count, low, high - low + 1);
+        return;
+    }
+
+    uint64_t *scratch = keysort_alloc(count * sizeof(uint64_t));
+    radix_sort(keys, count, scratch);
+    free(scratch);
+}
+
+/*sort nodes into ascending key order*/
+
+void sort_nodes(node_heap **heap, int length)
+{
+    for (int index = 0; index < length; ++index) {
+        if (heap[index]->key[0] != '\0' && heap[index]->key[1] != '\0') {
+            build_max_heap(heap, length);
+            heapsort(heap, length);
+            return;
+        }
+    }
+
+    /* Stable counting sort of the node pointers by their single byte */
+    size_t offsets[256] = { 0 };
+    for (int index = 0; index < length; ++index)
+        ++offsets[(unsigned char) heap[index]->key[0]];
+
+    size_t offset = 0;
+    for (int value = 0; value < 256; ++value) {
+        const size_t value_count = offsets[value];
+        offsets[value] = offset;
+        offset += value_count;
+    }
+
+    node_heap **sorted = keysort_alloc((length + 1) * sizeof(node_heap *));
+    for (int index = 0; index < length; ++index)
+        sorted[offsets[(unsigned char) heap[index]->key[0]]++] = heap[index];
+
+    memcpy(heap, sorted, length * sizeof(node_heap *));
+    COUNT_MOVES(2 * length);
+    free(sorted);
+}
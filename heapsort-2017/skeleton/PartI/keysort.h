@@ -0,0 +1,29 @@
+#ifndef _KEYSORT_H_
+#define _KEYSORT_H_
+
+#include "binaryheap.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Non-comparison sorts for keys drawn from a known domain. Each runs
+ * in O(n) passes of sequential reads and writes, instead of the
+ * O(n log n) scattered accesses of heapsort, which remains the path for
+ * keys that can only be compared. */
+
+/* Keys spanning fewer values than this, and than 2 * count + 256, are
+ * counting sorted */
+#define COUNTING_SORT_RANGE (1 << 16)
+
+/*sort bytes into ascending order with a 256-bin histogram*/
+void counting_sort_bytes(unsigned char *keys, size_t count);
+
+/*sort keys into ascending order with an LSD radix sort, one byte per pass; scratch must hold count keys*/
+void radix_sort(uint64_t *keys, size_t count, uint64_t *scratch);
+
+/*sort keys into ascending order: insertion sort for a handful of keys, counting sort when they span a range small for their count, radix sort otherwise*/
+void sort_keys(uint64_t *keys, size_t count);
+
+/*sort nodes into ascending key order: counting sort when every key is a single byte, build_max_heap and heapsort otherwise. Nodes with equal keys keep their order*/
+void sort_nodes(node_heap **heap, int length);
+
+#endif
@@ -0,0 +1,215 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mq.h"
+#include "dheap.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CACHE_LINE 64
+#define INITIAL_QUEUE_CAPACITY 64
+#define QUEUE_ARITY 4
+
+/* Attempts at a random pair of heaps before a pop scans all of them */
+#define POP_ATTEMPTS 8
+
+/* One heap. count and top are written under the lock but read without
+ * it to choose a heap. */
+typedef struct mq_heap_t {
+    int lock;
+    size_t count;
+    uint64_t top;
+    size_t capacity;
+    mq_entry *entries;
+} mq_heap;
+
+/* Each heap gets its own cache line so that threads working on
+ * neighbouring heaps do not share lines */
+union mq_queue_t {
+    mq_heap heap;
+    char line[CACHE_LINE];
+};
+
+static int compare_entries(const void *a, const void *b)
+{
+    const uint64_t key1 = ((const mq_entry *) a)->key;
+    const uint64_t key2 = ((const mq_entry *) b)->key;
+
+    return (key1 > key2) - (key1 < key2);
+}
+
+static unsigned int next_random(unsigned int *seed)
+{
+    unsigned int x = *seed != 0 ? *seed : 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+static int try_lock(mq_heap *queue)
+{
+    return __atomic_load_n(&queue->lock, __ATOMIC_RELAXED) == 0
+        && !__atomic_exchange_n(&queue->lock, 1, __ATOMIC_ACQUIRE);
+}
+
+static void unlock(mq_heap *queue)
+{
+    __atomic_store_n(&queue->lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Publishes the heap's size and top for lock-free readers */
+static void publish(mq_heap *queue, size_t count)
+{
+    __atomic_store_n(&queue->top, count > 0 ? queue->entries[0].key : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue->count, count, __ATOMIC_RELEASE);
+}
+
+static void queue_heap(struct dheap *heap, mq_heap *queue)
+{
+    dheap_init(heap, queue->entries, sizeof(mq_entry), QUEUE_ARITY, &compare_entries);
+}
+
+/* Pops the top of a locked, non-empty heap */
+static void queue_pop(mq_heap *queue, mq_entry *out)
+{
+    struct dheap heap;
+    size_t count = queue->count;
+
+    *out = queue->entries[0];
+    queue->entries[0] = queue->entries[--count];
+
+    if (count > 0) {
+        queue_heap(&heap, queue);
+        dheap_sift_down(&heap, 0, count);
+    }
+
+    publish(queue, count);
+}
+
+
+/*initialise an empty multiqueue of queue_count heaps*/
+
+void mq_init(multiqueue *mq, int queue_count)
+{
+    assert(mq != NULL);
+    assert(queue_count > 0);
+
+    void *queues;
+    if (posix_memalign(&queues, CACHE_LINE, queue_count * sizeof(mq_queue)) != 0) {
+        perror("mq_init");
+        exit(EXIT_FAILURE);
+    }
+
+    mq->queues = queues;
+    mq->queue_count = queue_count;
+
+    for (int index = 0; index < queue_count; ++index) {
+        mq_heap *queue = &mq->queues[index].heap;
+        queue->lock = 0;
+        queue->count = 0;
+        queue->top = 0;
+        queue->capacity = INITIAL_QUEUE_CAPACITY;
+        queue->entries = malloc(queue->capacity * sizeof(mq_entry));
+        if (queue->entries == NULL) {
+            perror("mq_init");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*free the memory allocated by the multiqueue*/
+
+void mq_free(multiqueue *mq)
+{
+    for (int index = 0; index < mq->queue_count; ++index)
+        free(mq->queues[index].heap.entries);
+
+    free(mq->queues);
+}
+
+/*insert a value with the given key*/
+
+void mq_push(multiqueue *mq, uint64_t key, void *value, unsigned int *seed)
+{
+    mq_heap *queue;
+    do {
+        queue = &mq->queues[next_random(seed) % mq->queue_count].heap;
+    } while (!try_lock(queue));
+
+    if (queue->count == queue->capacity) {
+        queue->capacity *= 2;
+        queue->entries = realloc(queue->entries, queue->capacity * sizeof(mq_entry));
+        if (queue->entries == NULL) {
+            perror("mq_push");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const size_t count = queue->count;
+    queue->entries[count].key = key;
+    queue->entries[count].value = value;
+
+    struct dheap heap;
+    queue_heap(&heap, queue);
+    dheap_sift_up(&heap, count);
+
+    publish(queue, count + 1);
+    unlock(queue);
+}
+
+/*remove an entry with one of the largest keys*/
+
+int mq_pop(multiqueue *mq, mq_entry *out, unsigned int *seed)
+{
+    for (int attempt = 0; attempt < POP_ATTEMPTS; ++attempt) {
+        mq_heap *first = &mq->queues[next_random(seed) % mq->queue_count].heap;
+        mq_heap *second = &mq->queues[next_random(seed) % mq->queue_count].heap;
+
+        const size_t first_count = __atomic_load_n(&first->count, __ATOMIC_ACQUIRE);
+        const size_t second_count = __atomic_load_n(&second->count, __ATOMIC_ACQUIRE);
+        if (first_count == 0 && second_count == 0)
+            continue;
+
+        mq_heap *queue = first;
+        if (first_count == 0 || (second_count > 0
+            && __atomic_load_n(&second->top, __ATOMIC_RELAXED) > __atomic_load_n(&first->top, __ATOMIC_RELAXED)))
+            queue = second;
+
+        if (!try_lock(queue))
+            continue;
+
+        /* The heap may have been emptied since it was chosen */
+        if (queue->count > 0) {
+            queue_pop(queue, out);
+            unlock(queue);
+            return 1;
+        }
+
+        unlock(queue);
+    }
+
+    /* Mostly empty: look at every heap before reporting empty */
+    const int start = next_random(seed) % mq->queue_count;
+    for (int offset = 0; offset < mq->queue_count; ++offset) {
+        mq_heap *queue = &mq->queues[(start + offset) % mq->queue_count].heap;
+
+        if (__atomic_load_n(&queue->count, __ATOMIC_ACQUIRE) == 0)
+            continue;
+
+        while (!try_lock(queue))
+            sched_yield();
+
+        if (queue->count > 0) {
+            queue_pop(queue, out);
+            unlock(queue);
+            return 1;
+        }
+
+        unlock(queue);
+    }
+
+    return 0;
+}
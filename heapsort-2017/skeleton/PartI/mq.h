@@ -0,0 +1,39 @@
+#ifndef _MQ_H_
+#define _MQ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A concurrent priority queue in the MultiQueue style: several heaps,
+ * each behind its own spin lock. A push goes to a random heap. A pop
+ * looks at the tops of two random heaps, without locking, and takes
+ * from the one with the larger key. Threads rarely meet on the same
+ * lock. The price is that pops come out in nearly, not exactly,
+ * priority order. With a few heaps per thread, a popped key is
+ * usually among the largest few per heap. */
+
+typedef struct mq_entry_t {
+    uint64_t key;
+    void *value;
+} mq_entry;
+
+typedef union mq_queue_t mq_queue;
+
+typedef struct multiqueue_t {
+    mq_queue *queues;
+    int queue_count;
+} multiqueue;
+
+/*initialise an empty multiqueue of queue_count heaps; about twice the number of threads using it works well*/
+void mq_init(multiqueue *mq, int queue_count);
+
+/*free the memory allocated by the multiqueue, which must no longer be in use*/
+void mq_free(multiqueue *mq);
+
+/*insert a value with the given key; seed is the calling thread's random state*/
+void mq_push(multiqueue *mq, uint64_t key, void *value, unsigned int *seed);
+
+/*remove an entry with one of the largest keys into *out, returning 0 if the queue was found empty*/
+int mq_pop(multiqueue *mq, mq_entry *out, unsigned int *seed);
+
+#endif
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dheap.h"
+#include "mq.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Measures push/pop throughput under contention for 1 to 64 threads,
+ * comparing the multiqueue with a single dheap behind one mutex. The
+ * queue is prefilled, then every thread alternates a push of a random
+ * key with a pop, as a worker pool feeding itself would. */
+
+#define PREFILL (1 << 20)
+#define DEFAULT_OPERATIONS (1 << 20)
+#define QUEUES_PER_THREAD 2
+
+typedef struct locked_heap_t {
+    pthread_mutex_t lock;
+    mq_entry *entries;
+    size_t count;
+} locked_heap;
+
+typedef struct bench_t {
+    int multi;
+    multiqueue mq;
+    locked_heap single;
+    long operations;
+    pthread_barrier_t start;
+} bench;
+
+typedef struct worker_t {
+    pthread_t thread;
+    bench *b;
+    unsigned int seed;
+    long empty_pops;
+} worker;
+
+static int compare_entries(const void *a, const void *b)
+{
+    const uint64_t key1 = ((const mq_entry *) a)->key;
+    const uint64_t key2 = ((const mq_entry *) b)->key;
+
+    return (key1 > key2) - (key1 < key2);
+}
+
+static void locked_push(locked_heap *h, uint64_t key)
+{
+    struct dheap heap;
+
+    pthread_mutex_lock(&h->lock);
+    h->entries[h->count].key = key;
+    h->entries[h->count].value = NULL;
+    dheap_init(&heap, h->entries, sizeof(mq_entry), 4, &compare_entries);
+    dheap_sift_up(&heap, h->count++);
+    pthread_mutex_unlock(&h->lock);
+}
+
+static int locked_pop(locked_heap *h, mq_entry *out)
+{
+    struct dheap heap;
+    int found = 0;
+
+    pthread_mutex_lock(&h->lock);
+    if (h->count > 0) {
+        *out = h->entries[0];
+        h->entries[0] = h->entries[--h->count];
+        dheap_init(&heap, h->entries, sizeof(mq_entry), 4, &compare_entries);
+        if (h->count > 0)
+            dheap_sift_down(&heap, 0, h->count);
+        found = 1;
+    }
+    pthread_mutex_unlock(&h->lock);
+
+    return found;
+}
+
+static void *bench_worker(void *arg)
+{
+    worker *w = arg;
+    bench *b = w->b;
+    mq_entry entry;
+
+    pthread_barrier_wait(&b->start);
+
+    for (long op = 0; op < b->operations; ++op) {
+        const uint64_t key = ((uint64_t) rand_r(&w->seed) << 31) ^ rand_r(&w->seed);
+
+        if (b->multi) {
+            mq_push(&b->mq, key, NULL, &w->seed);
+            if (!mq_pop(&b->mq, &entry, &w->seed))
+                ++w->empty_pops;
+        }
+        else {
+            locked_push(&b->single, key);
+            if (!locked_pop(&b->single, &entry))
+                ++w->empty_pops;
+        }
+    }
+
+    pthread_barrier_wait(&b->start);
+    return NULL;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(int multi, int thread_count, long operations)
+{
+    bench b;
+    b.multi = multi;
+    b.operations = operations;
+    unsigned int seed = 12345;
+
+    if (multi) {
+        mq_init(&b.mq, QUEUES_PER_THREAD * thread_count);
+        for (long index = 0; index < PREFILL; ++index)
+            mq_push(&b.mq, rand_r(&seed), NULL, &seed);
+    }
+    else {
+        pthread_mutex_init(&b.single.lock, NULL);
+        b.single.entries = malloc((PREFILL + thread_count + 1) * sizeof(mq_entry));
+        if (b.single.entries == NULL) {
+            perror("mqbench");
+            exit(EXIT_FAILURE);
+        }
+        b.single.count = 0;
+        for (long index = 0; index < PREFILL; ++index)
+            locked_push(&b.single, rand_r(&seed));
+    }
+
+    worker *workers = malloc(thread_count * sizeof(worker));
+    if (workers == NULL) {
+        perror("mqbench");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_barrier_init(&b.start, NULL, thread_count + 1);
+    for (int index = 0; index < thread_count; ++index) {
+        workers[index].b = &b;
+        workers[index].seed = index + 1;
+        workers[index].empty_pops = 0;
+        pthread_create(&workers[index].thread, NULL, &bench_worker, &workers[index]);
+    }
+
+    pthread_barrier_wait(&b.start);
+    const double start = now();
+    pthread_barrier_wait(&b.start);
+    const double elapsed = now() - start;
+
+    long empty_pops = 0;
+    for (int index = 0; index < thread_count; ++index) {
+        pthread_join(workers[index].thread, NULL);
+        empty_pops += workers[index].empty_pops;
+    }
+
+    const double pairs = (double) operations * thread_count;
+    printf("%-12s %3d threads %8.2f Mops/s %8.1f ns/op%s\n", multi ? "multiqueue" : "locked-heap",
+           thread_count, 2 * pairs / elapsed / 1e6, elapsed * 1e9 / (2 * pairs / thread_count),
+           empty_pops > 0 ? "  (some pops found it empty)" : "");
+    fflush(stdout);
+
+    pthread_barrier_destroy(&b.start);
+    free(workers);
+
+    if (multi) {
+        mq_free(&b.mq);
+    }
+    else {
+        free(b.single.entries);
+        pthread_mutex_destroy(&b.single.lock);
+    }
+}
+
+int main(int argc, char **argv){
+
+    long operations = argc > 1 ? atol(argv[1]) : DEFAULT_OPERATIONS;
+    if (operations <= 0) {
+        fprintf(stderr, "Usage: %s [total operations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        run(0, threads, operations / threads);
+        run(1, threads, operations / threads);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+#include "pq.h"
+#include "binaryheap.h"
+#include "sortcount.h"
+#include <assert.h>
+
+#define NOT_QUEUED -1
+
+/* Returns 1 if handle a belongs nearer the front than handle b */
+static int before(const priority_queue *pq, int a, int b)
+{
+    COUNT_COMPARISON();
+
+    if (pq->order == PQ_MAX)
+        return pq->keys[a] > pq->keys[b];
+
+    return pq->keys[a] < pq->keys[b];
+}
+
+/* Stores handle at heap index and records the index in the position map */
+static void place(priority_queue *pq, int index, int handle)
+{
+    COUNT_MOVE();
+    pq->heap[index] = handle;
+    pq->positions[handle] = index;
+}
+
+/* Moves the handle at index towards the root while it belongs before its parent */
+static void sift_up(priority_queue *pq, int index)
+{
+    const int handle = pq->heap[index];
+
+    while (index > 0 && before(pq, handle, pq->heap[parent(index)])) {
+        place(pq, index, pq->heap[parent(index)]);
+        index = parent(index);
+    }
+
+    place(pq, index, handle);
+}
+
+/* Moves the handle at index towards the leaves while a child belongs before it */
+static void sift_down(priority_queue *pq, int index)
+{
+    const int handle = pq->heap[index];
+
+    for (;;) {
+        int child = left_child(index);
+        if (child >= pq->size)
+            break;
+
+        if (right_child(index) < pq->size && before(pq, pq->heap[right_child(index)], pq->heap[child]))
+            child = right_child(index);
+
+        if (!before(pq, pq->heap[child], handle))
+            break;
+
+        place(pq, index, pq->heap[child]);
+        index = child;
+    }
+
+    place(pq, index, handle);
+}
+
+static void *pq_alloc(size_t size)
+{
+    void *memory = malloc(size);
+    if (memory == NULL) {
+        perror("pq_init");
+        exit(EXIT_FAILURE);
+    }
+
+    return memory;
+}
+
+
+/*initialise an empty queue for handles 0 .. capacity-1*/
+
+void pq_init(priority_queue *pq, int capacity, pq_order order)
+{
+    assert(pq != NULL);
+    assert(capacity >= 0);
+
+    pq->order = order;
+    pq->capacity = capacity;
+    pq->size = 0;
+    pq->heap = pq_alloc((capacity + 1) * sizeof(int));
+    pq->positions = pq_alloc((capacity + 1) * sizeof(int));
+    pq->keys = pq_alloc((capacity + 1) * sizeof(long long));
+
+    for (int handle = 0; handle < capacity; ++handle)
+        pq->positions[handle] = NOT_QUEUED;
+}
+
+/*free the memory allocated by the queue*/
+
+void pq_free(priority_queue *pq)
+{
+    free(pq->heap);
+    free(pq->positions);
+    free(pq->keys);
+}
+
+/*returns the number of entries in the queue*/
+
+int pq_size(const priority_queue *pq)
+{
+    return pq->size;
+}
+
+/*returns 1 if the handle is in the queue, 0 otherwise*/
+
+int pq_contains(const priority_queue *pq, int handle)
+{
+    assert(handle >= 0 && handle < pq->capacity);
+
+    return pq->positions[handle] != NOT_QUEUED;
+}
+
+/*returns the key of a handle in the queue*/
+
+long long pq_key(const priority_queue *pq, int handle)
+{
+    assert(pq_contains(pq, handle));
+
+    return pq->keys[handle];
+}
+
+/*inserts a handle that is not in the queue with the given key*/
+
+void pq_push(priority_queue *pq, int handle, long long key)
+{
+    assert(!pq_contains(pq, handle));
+
+    pq->keys[handle] = key;
+    place(pq, pq->size, handle);
+    ++pq->size;
+    sift_up(pq, pq->size - 1);
+}
+
+/*returns the handle at the front of a non-empty queue without removing it*/
+
+int pq_peek(const priority_queue *pq)
+{
+    assert(pq->size > 0);
+
+    return pq->heap[0];
+}
+
+/*removes the handle at the front of a non-empty queue and returns it*/
+
+int pq_pop(priority_queue *pq, long long *key)
+{
+    const int handle = pq_peek(pq);
+
+    if (key != NULL)
+        *key = pq->keys[handle];
+
+    pq_remove(pq, handle);
+    return handle;
+}
+
+/*changes the key of a handle in the queue, in either direction*/
+
+void pq_update_key(priority_queue *pq, int handle, long long key)
+{
+    assert(pq_contains(pq, handle));
+
+    const int raised = pq->order == PQ_MAX ? key > pq->keys[handle] : key < pq->keys[handle];
+    pq->keys[handle] = key;
+
+    if (raised)
+        sift_up(pq, pq->positions[handle]);
+    else
+        sift_down(pq, pq->positions[handle]);
+}
+
+/*removes a handle from the queue*/
+
+void pq_remove(priority_queue *pq, int handle)
+{
+    assert(pq_contains(pq, handle));
+
+    const int index = pq->positions[handle];
+    pq->positions[handle] = NOT_QUEUED;
+    --pq->size;
+
+    if (index == pq->size)
+        return;
+
+    /* Fill the hole with the last entry, which may need to go either way */
+    const int moved = pq->heap[pq->size];
+    place(pq, index, moved);
+    sift_up(pq, index);
+
+    if (pq->positions[moved] == index)
+        sift_down(pq, index);
+}
@@ -0,0 +1,54 @@
+#ifndef _PQ_H_
+#define _PQ_H_
+
+/* An indexed priority queue. Each entry is named by a handle, an int
+ * in [0, capacity) chosen by the caller (a vertex or task number), and
+ * carries a key. The queue is a binary heap of handles laid out by
+ * parent(), left_child() and right_child(); a position map from handle
+ * to heap index lets update_key and remove find an entry without
+ * searching, so every operation but peek is O(log n). */
+
+typedef enum { PQ_MAX, PQ_MIN } pq_order;
+
+typedef struct priority_queue_t priority_queue;
+
+struct priority_queue_t{
+ pq_order order;
+ int capacity;
+ int size;
+ int *heap;
+ int *positions;
+ long long *keys;
+};
+
+/*initialise an empty queue for handles 0 .. capacity-1, largest key first for PQ_MAX, smallest first for PQ_MIN*/
+void pq_init(priority_queue *pq, int capacity, pq_order order);
+
+/*free the memory allocated by the queue*/
+void pq_free(priority_queue *pq);
+
+/*returns the number of entries in the queue*/
+int pq_size(const priority_queue *pq);
+
+/*returns 1 if the handle is in the queue, 0 otherwise*/
+int pq_contains(const priority_queue *pq, int handle);
+
+/*returns the key of a handle in the queue*/
+long long pq_key(const priority_queue *pq, int handle);
+
+/*inserts a handle that is not in the queue with the given key*/
+void pq_push(priority_queue *pq, int handle, long long key);
+
+/*returns the handle at the front of a non-empty queue without removing it*/
+int pq_peek(const priority_queue *pq);
+
+/*removes the handle at the front of a non-empty queue and returns it, storing its key in *key unless key is NULL*/
+int pq_pop(priority_queue *pq, long long *key);
+
+/*changes the key of a handle in the queue, in either direction*/
+void pq_update_key(priority_queue *pq, int handle, long long key);
+
+/*removes a handle from the queue*/
+void pq_remove(priority_queue *pq, int handle);
+
+#endif
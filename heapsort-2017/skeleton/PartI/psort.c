@@ -0,0 +1,249 @@
+#include "psort.h"
+#include "dheap.h"
+#include "sortcount.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Partitions smaller than this are sorted by insertion sort */
+#define INSERTION_CUTOFF 24
+
+/* Partitions larger than this are offered to the other threads */
+#define PARALLEL_CUTOFF (1 << 15)
+
+#define FALLBACK_ARITY 4
+
+/* A partition waiting to be sorted, and the recursion depth it may
+ * still use before falling back to heapsort */
+typedef struct sort_task_t {
+    uint64_t *keys;
+    size_t count;
+    int depth;
+} sort_task;
+
+/* Tasks are kept on a stack; pending counts tasks queued or running,
+ * so the sort is finished when it reaches 0 */
+typedef struct sort_pool_t {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    sort_task *tasks;
+    size_t task_count;
+    size_t task_capacity;
+    size_t pending;
+} sort_pool;
+
+static int compare_keys(const void *a, const void *b)
+{
+    const uint64_t key1 = *(const uint64_t *) a;
+    const uint64_t key2 = *(const uint64_t *) b;
+
+    return (key1 > key2) - (key1 < key2);
+}
+
+static int less(uint64_t a, uint64_t b)
+{
+    COUNT_COMPARISON();
+    return a < b;
+}
+
+static void insertion_sort(uint64_t *keys, size_t count)
+{
+    for (size_t index = 1; index < count; ++index) {
+        const uint64_t key = keys[index];
+        size_t hole = index;
+
+        for (; hole > 0 && less(key, keys[hole - 1]); --hole)
+            keys[hole] = keys[hole - 1];
+
+        keys[hole] = key;
+        COUNT_MOVES(index - hole + 1);
+    }
+}
+
+static void heap_fallback(uint64_t *keys, size_t count)
+{
+    struct dheap heap;
+    dheap_init(&heap, keys, sizeof(uint64_t), FALLBACK_ARITY, &compare_keys);
+    dheap_sort(&heap, count);
+}
+
+static uint64_t median_of_three(uint64_t a, uint64_t b, uint64_t c)
+{
+    if (a < b) {
+        if (b < c)
+            return b;
+        return a < c ? c : a;
+    }
+
+    if (a < c)
+        return a;
+    return b < c ? c : b;
+}
+
+/* Hoare partition around the median of the first, middle and last
+ * keys. Returns the size of the left part; every key in it is no
+ * larger than every key in the right part, and neither part is empty. */
+static size_t partition(uint64_t *keys, size_t count)
+{
+    const uint64_t pivot = median_of_three(keys[0], keys[count / 2], keys[count - 1]);
+    size_t left = 0;
+    size_t right = count - 1;
+
+    for (;;) {
+        while (less(keys[left], pivot))
+            ++left;
+        while (less(pivot, keys[right]))
+            --right;
+
+        if (left >= right)
+            return right + 1;
+
+        const uint64_t temp = keys[left];
+        keys[left++] = keys[right];
+        keys[right--] = temp;
+        COUNT_MOVES(2);
+    }
+}
+
+static void pool_push(sort_pool *pool, uint64_t *keys, size_t count, int depth)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->task_count == pool->task_capacity) {
+        pool->task_capacity *= 2;
+        pool->tasks = realloc(pool->tasks, pool->task_capacity * sizeof(sort_task));
+        if (pool->tasks == NULL) {
+            perror("parallel_sort");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    sort_task *task = &pool->tasks[pool->task_count++];
+    task->keys = keys;
+    task->count = count;
+    task->depth = depth;
+    ++pool->pending;
+
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Sorts one partition. Large subpartitions are pushed to the pool (if
+ * there is one) and the rest is sorted here, looping on one side to
+ * keep the stack shallow. */
+static void sort_range(sort_pool *pool, uint64_t *keys, size_t count, int depth)
+{
+    while (count > INSERTION_CUTOFF) {
+        if (depth == 0) {
+            heap_fallback(keys, count);
+            return;
+        }
+
+        --depth;
+        const size_t split = partition(keys, count);
+        uint64_t *small = keys, *large = keys + split;
+        size_t small_count = split, large_count = count - split;
+
+        if (small_count > large_count) {
+            small = large;
+            large = keys;
+            small_count = large_count;
+            large_count = split;
+        }
+
+        if (pool != NULL && small_count > PARALLEL_CUTOFF)
+            pool_push(pool, small, small_count, depth);
+        else
+            sort_range(pool, small, small_count, depth);
+
+        keys = large;
+        count = large_count;
+    }
+
+    insertion_sort(keys, count);
+}
+
+/* Thread body: runs tasks until none are queued or running */
+static void *sort_worker(void *arg)
+{
+    sort_pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->task_count == 0 && pool->pending > 0)
+            pthread_cond_wait(&pool->ready, &pool->lock);
+
+        if (pool->pending == 0)
+            break;
+
+        const sort_task task = pool->tasks[--pool->task_count];
+        pthread_mutex_unlock(&pool->lock);
+
+        sort_range(pool, task.keys, task.count, task.depth);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/* Twice the floor of log2(count), the usual introsort depth limit */
+static int depth_limit(size_t count)
+{
+    int depth = 0;
+    for (; count > 1; count >>= 1)
+        depth += 2;
+
+    return depth;
+}
+
+void parallel_sort(uint64_t *keys, size_t count, int thread_count)
+{
+    assert(keys != NULL || count == 0);
+    assert(thread_count > 0);
+
+    if (thread_count == 1 || count <= PARALLEL_CUTOFF) {
+        sort_range(NULL, keys, count, depth_limit(count));
+        return;
+    }
+
+    sort_pool pool;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pool.task_capacity = 64;
+    pool.task_count = 0;
+    pool.pending = 0;
+    pool.tasks = malloc(pool.task_capacity * sizeof(sort_task));
+    if (pool.tasks == NULL) {
+        perror("parallel_sort");
+        exit(EXIT_FAILURE);
+    }
+
+    pool_push(&pool, keys, count, depth_limit(count));
+
+    pthread_t *threads = malloc((thread_count - 1) * sizeof(pthread_t));
+    if (threads == NULL) {
+        perror("parallel_sort");
+        exit(EXIT_FAILURE);
+    }
+
+    int started = 0;
+    for (; started < thread_count - 1; ++started) {
+        if (pthread_create(&threads[started], NULL, &sort_worker, &pool) != 0)
+            break;
+    }
+
+    sort_worker(&pool);
+
+    for (int index = 0; index < started; ++index)
+        pthread_join(threads[index], NULL);
+
+    free(threads);
+    free(pool.tasks);
+    pthread_cond_destroy(&pool.ready);
+    pthread_mutex_destroy(&pool.lock);
+}
@@ -0,0 +1,14 @@
+#ifndef _PSORT_H_
+#define _PSORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sorts keys into ascending order on thread_count threads (the calling
+ * thread included). This is an introsort: a quicksort whose partitions
+ * are handed to a pool of threads, falling back to the dheap heapsort
+ * for any partition that recurses too deep, so the worst case stays
+ * O(n log n). Tiny partitions are finished by insertion sort. */
+void parallel_sort(uint64_t *keys, size_t count, int thread_count);
+
+#endif
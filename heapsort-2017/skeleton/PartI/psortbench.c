@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dheap.h"
+#include "psort.h"
+#include "keysort.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Times qsort(), the single-threaded heapsort path, parallel_sort() and
+ * the radix path of sort_keys() on the same random 64-bit keys for each
+ * size given on the command line, checking every result. Sizes may be
+ * written as powers of ten, e.g. 1e9 (which needs 16GB: the keys and a
+ * copy). */
+
+#define DEFAULT_SIZES "1e6 1e7 1e8"
+
+typedef struct contender_t {
+    const char *name;
+    void (*sort)(uint64_t *keys, size_t count, int thread_count);
+} contender;
+
+static int compare_keys(const void *a, const void *b)
+{
+    const uint64_t key1 = *(const uint64_t *) a;
+    const uint64_t key2 = *(const uint64_t *) b;
+
+    return (key1 > key2) - (key1 < key2);
+}
+
+static void run_qsort(uint64_t *keys, size_t count, int thread_count)
+{
+    qsort(keys, count, sizeof(uint64_t), &compare_keys);
+}
+
+static void run_heapsort(uint64_t *keys, size_t count, int thread_count)
+{
+    struct dheap heap;
+    dheap_init(&heap, keys, sizeof(uint64_t), 2, &compare_keys);
+    dheap_sort(&heap, count);
+}
+
+static void run_serial(uint64_t *keys, size_t count, int thread_count)
+{
+    parallel_sort(keys, count, 1);
+}
+
+static void run_parallel(uint64_t *keys, size_t count, int thread_count)
+{
+    parallel_sort(keys, count, thread_count);
+}
+
+static void run_sort_keys(uint64_t *keys, size_t count, int thread_count)
+{
+    sort_keys(keys, count);
+}
+
+static const contender contenders[] = {
+    { "qsort", &run_qsort },
+    { "heapsort", &run_heapsort },
+    { "introsort-1", &run_serial },
+    { "introsort-N", &run_parallel },
+    { "radix", &run_sort_keys },
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static size_t parse_size(const char *text)
+{
+    return (size_t) strtod(text, NULL);
+}
+
+static void bench_size(size_t count, int thread_count)
+{
+    uint64_t *original = malloc(count * sizeof(uint64_t));
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    if (original == NULL || keys == NULL) {
+        fprintf(stderr, "psortbench: not enough memory for %zu keys\n", count);
+        free(original);
+        free(keys);
+        return;
+    }
+
+    uint64_t state = 88172645463325252ULL;
+    for (size_t index = 0; index < count; ++index)
+        original[index] = next_random(&state);
+
+    for (size_t c = 0; c < sizeof(contenders) / sizeof(contenders[0]); ++c) {
+        memcpy(keys, original, count * sizeof(uint64_t));
+
+        const double start = now();
+        contenders[c].sort(keys, count, thread_count);
+        const double elapsed = now() - start;
+
+        int sorted = 1;
+        for (size_t index = 1; index < count && sorted; ++index)
+            sorted = keys[index - 1] <= keys[index];
+
+        printf("%12zu  %-12s %10.3f s %8.1f Mkeys/s%s\n", count, contenders[c].name,
+               elapsed, count / elapsed / 1e6, sorted ? "" : "  NOT SORTED");
+        fflush(stdout);
+    }
+
+    free(original);
+    free(keys);
+}
+
+int main(int argc, char **argv){
+
+    int thread_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        thread_count = atoi(argv[2]);
+        first = 3;
+    }
+
+    if (thread_count <= 0) {
+        fprintf(stderr, "Usage: %s [-t threads] [size ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("introsort-N uses %d threads\n", thread_count);
+
+    if (first == argc) {
+        char sizes[] = DEFAULT_SIZES;
+        for (char *size = strtok(sizes, " "); size != NULL; size = strtok(NULL, " "))
+            bench_size(parse_size(size), thread_count);
+    }
+
+    for (int index = first; index < argc; ++index)
+        bench_size(parse_size(argv[index]), thread_count);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,384 @@
+#define _GNU_SOURCE
+
+#include "binaryheap.h"
+#include "dheap.h"
+#include "keysort.h"
+#include "pq.h"
+#include "psort.h"
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Benchmarks every heap and sort path over several input
+ * distributions and sizes. For each run it reports the time per
+ * element and, through the sortcount.h hooks this program is built
+ * with, the comparisons and element moves per element. Where the
+ * kernel allows it, it also reports last-level cache misses per
+ * element from a perf_event_open() counter.
+ *
+ * Usage: sortbench [size ...]    (default 1e3 1e5 1e6) */
+
+#define DEFAULT_SIZES "1e3 1e5 1e6"
+#define FEW_UNIQUE 16
+#define NODE_KEY_LENGTH 21
+
+unsigned long long sort_comparisons;
+unsigned long long sort_moves;
+
+typedef void (*distribution_fill)(uint64_t *keys, size_t count);
+
+typedef struct distribution_t {
+    const char *name;
+    distribution_fill fill;
+} distribution;
+
+/* Prepares the input for a run outside the timed region, runs it, and
+ * releases what it prepared */
+typedef struct algorithm_t {
+    const char *name;
+    void *(*prepare)(const uint64_t *keys, size_t count);
+    void (*run)(void *input, size_t count);
+    void (*release)(void *input, size_t count);
+} algorithm;
+
+static uint64_t random_state;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static void fill_random(uint64_t *keys, size_t count)
+{
+    for (size_t index = 0; index < count; ++index)
+        keys[index] = next_random();
+}
+
+static void fill_sorted(uint64_t *keys, size_t count)
+{
+    for (size_t index = 0; index < count; ++index)
+        keys[index] = index;
+}
+
+static void fill_reverse(uint64_t *keys, size_t count)
+{
+    for (size_t index = 0; index < count; ++index)
+        keys[index] = count - index;
+}
+
+static void fill_few_unique(uint64_t *keys, size_t count)
+{
+    for (size_t index = 0; index < count; ++index)
+        keys[index] = next_random() % FEW_UNIQUE;
+}
+
+/* Returns 1 if keys holds each of 1..count exactly once */
+static int is_permutation(const uint64_t *keys, size_t count)
+{
+    unsigned char *seen = calloc(count + 1, 1);
+    if (seen == NULL) {
+        perror("sortbench");
+        exit(EXIT_FAILURE);
+    }
+
+    int permutation = 1;
+    for (size_t index = 0; index < count && permutation; ++index) {
+        permutation = keys[index] >= 1 && keys[index] <= count && !seen[keys[index]];
+        if (permutation)
+            seen[keys[index]] = 1;
+    }
+
+    free(seen);
+    return permutation;
+}
+
+/* Musser's median-of-3 killer, which drives a quicksort that takes the
+ * median of the first, middle and last keys towards quadratic time. The
+ * construction needs an even half, so it covers the largest multiple of
+ * 4 keys and the rest follow in order */
+static void fill_median_killer(uint64_t *keys, size_t count)
+{
+    const size_t half = count / 4 * 2;
+
+    for (size_t index = 1; index < half; index += 2) {
+        keys[index - 1] = index;
+        keys[index] = half + index;
+    }
+
+    for (size_t index = 1; index <= half; ++index)
+        keys[half + index - 1] = 2 * index;
+
+    for (size_t index = 2 * half; index < count; ++index)
+        keys[index] = index + 1;
+
+    if (!is_permutation(keys, count)) {
+        fprintf(stderr, "sortbench: med3-killer is not a permutation of 1..%zu\n", count);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static const distribution distributions[] = {
+    { "random", &fill_random },
+    { "sorted", &fill_sorted },
+    { "reverse", &fill_reverse },
+    { "few-unique", &fill_few_unique },
+    { "med3-killer", &fill_median_killer },
+};
+
+static void *xmalloc(size_t size)
+{
+    void *memory = malloc(size);
+    if (memory == NULL) {
+        perror("sortbench");
+        exit(EXIT_FAILURE);
+    }
+
+    return memory;
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    const uint64_t key1 = *(const uint64_t *) a;
+    const uint64_t key2 = *(const uint64_t *) b;
+
+    return (key1 > key2) - (key1 < key2);
+}
+
+static void *copy_keys(const uint64_t *keys, size_t count)
+{
+    uint64_t *copy = xmalloc((count + 1) * sizeof(uint64_t));
+    memcpy(copy, keys, count * sizeof(uint64_t));
+    return copy;
+}
+
+static void free_input(void *input, size_t count)
+{
+    free(input);
+}
+
+/* Node keys are zero-padded decimal, so strcmp() orders them by value */
+static void *make_nodes(const uint64_t *keys, size_t count)
+{
+    node_heap **heap = xmalloc((count + 1) * sizeof(node_heap *));
+
+    for (size_t index = 0; index < count; ++index) {
+        heap[index] = allocate_node_heap();
+        heap[index]->key = xmalloc(NODE_KEY_LENGTH);
+        sprintf(heap[index]->key, "%020llu", (unsigned long long) keys[index]);
+        heap[index]->position = index;
+    }
+
+    return heap;
+}
+
+static void free_nodes(void *input, size_t count)
+{
+    free_heap(input, count);
+}
+
+static void *make_bytes(const uint64_t *keys, size_t count)
+{
+    unsigned char *bytes = xmalloc(count + 1);
+    for (size_t index = 0; index < count; ++index)
+        bytes[index] = keys[index];
+
+    return bytes;
+}
+
+static void run_build_max_heap(void *input, size_t count)
+{
+    build_max_heap(input, count);
+}
+
+static void run_heapsort(void *input, size_t count)
+{
+    build_max_heap(input, count);
+    heapsort(input, count);
+}
+
+static void run_dheap(void *input, size_t count, unsigned arity)
+{
+    struct dheap heap;
+    dheap_init(&heap, input, sizeof(uint64_t), arity, &compare_keys);
+    dheap_sort(&heap, count);
+}
+
+static void run_dheap2(void *input, size_t count)
+{
+    run_dheap(input, count, 2);
+}
+
+static void run_dheap4(void *input, size_t count)
+{
+    run_dheap(input, count, 4);
+}
+
+static void run_dheap8(void *input, size_t count)
+{
+    run_dheap(input, count, 8);
+}
+
+static void run_introsort(void *input, size_t count)
+{
+    parallel_sort(input, count, 1);
+}
+
+static void run_sort_keys(void *input, size_t count)
+{
+    sort_keys(input, count);
+}
+
+static void run_counting_bytes(void *input, size_t count)
+{
+    counting_sort_bytes(input, count);
+}
+
+/* Pushes every key into a max queue, then pops them all */
+static void run_pq_push_pop(void *input, size_t count)
+{
+    const uint64_t *keys = input;
+    priority_queue pq;
+    pq_init(&pq, count, PQ_MAX);
+
+    for (size_t handle = 0; handle < count; ++handle)
+        pq_push(&pq, handle, keys[handle] >> 1);
+
+    while (pq_size(&pq) > 0)
+        pq_pop(&pq, NULL);
+
+    pq_free(&pq);
+}
+
+/* Pushes every key, then gives every handle the key of another */
+static void run_pq_update_key(void *input, size_t count)
+{
+    const uint64_t *keys = input;
+    priority_queue pq;
+    pq_init(&pq, count, PQ_MAX);
+
+    for (size_t handle = 0; handle < count; ++handle)
+        pq_push(&pq, handle, keys[handle] >> 1);
+
+    for (size_t handle = 0; handle < count; ++handle)
+        pq_update_key(&pq, handle, keys[count - 1 - handle] >> 1);
+
+    pq_free(&pq);
+}
+
+static const algorithm algorithms[] = {
+    { "build_max_heap", &make_nodes, &run_build_max_heap, &free_nodes },
+    { "heapsort", &make_nodes, &run_heapsort, &free_nodes },
+    { "dheap-2", &copy_keys, &run_dheap2, &free_input },
+    { "dheap-4", &copy_keys, &run_dheap4, &free_input },
+    { "dheap-8", &copy_keys, &run_dheap8, &free_input },
+    { "introsort", &copy_keys, &run_introsort, &free_input },
+    { "sort_keys", &copy_keys, &run_sort_keys, &free_input },
+    { "counting-bytes", &make_bytes, &run_counting_bytes, &free_input },
+    { "pq-push-pop", &copy_keys, &run_pq_push_pop, &free_input },
+    { "pq-update-key", &copy_keys, &run_pq_update_key, &free_input },
+};
+
+/* Opens a counter of cache misses for this thread, or returns -1 */
+static int open_cache_counter(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(const algorithm *a, const distribution *d, const uint64_t *keys, size_t count, int counter)
+{
+    void *input = a->prepare(keys, count);
+
+    sort_comparisons = 0;
+    sort_moves = 0;
+    long long misses = -1;
+
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    const double start = now();
+    a->run(input, count);
+    const double elapsed = now() - start;
+
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+            misses = -1;
+    }
+
+    printf("%10zu  %-12s %-15s %10.2f %10.2f %10.2f", count, d->name, a->name,
+           elapsed * 1e9 / count, (double) sort_comparisons / count, (double) sort_moves / count);
+
+    if (misses >= 0)
+        printf(" %10.3f\n", (double) misses / count);
+    else
+        printf(" %10s\n", "n/a");
+
+    fflush(stdout);
+    a->release(input, count);
+}
+
+static void bench_size(size_t count, int counter)
+{
+    uint64_t *keys = xmalloc((count + 1) * sizeof(uint64_t));
+
+    for (size_t d = 0; d < sizeof(distributions) / sizeof(distributions[0]); ++d) {
+        random_state = 88172645463325252ULL;
+        distributions[d].fill(keys, count);
+
+        for (size_t a = 0; a < sizeof(algorithms) / sizeof(algorithms[0]); ++a)
+            bench(&algorithms[a], &distributions[d], keys, count, counter);
+    }
+
+    free(keys);
+}
+
+int main(int argc, char **argv){
+
+    const int counter = open_cache_counter();
+    if (counter < 0)
+        fprintf(stderr, "sortbench: cache miss counter unavailable, reporting n/a\n");
+
+    printf("%10s  %-12s %-15s %10s %10s %10s %10s\n", "size", "input", "algorithm",
+           "ns/elem", "cmp/elem", "moves/elem", "miss/elem");
+
+    if (argc == 1) {
+        char sizes[] = DEFAULT_SIZES;
+        for (char *size = strtok(sizes, " "); size != NULL; size = strtok(NULL, " "))
+            bench_size((size_t) strtod(size, NULL), counter);
+    }
+
+    for (int index = 1; index < argc; ++index)
+        bench_size((size_t) strtod(argv[index], NULL), counter);
+
+    if (counter >= 0)
+        close(counter);
+
+    return EXIT_SUCCESS;
+}
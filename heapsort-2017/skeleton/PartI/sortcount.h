@@ -0,0 +1,27 @@
+#ifndef _SORTCOUNT_H_
+#define _SORTCOUNT_H_
+
+/* Counting hooks for the benchmarks. When built with -DSORT_COUNTERS,
+ * the sorts and heaps count every key comparison and every element
+ * move into the globals below; otherwise the hooks compile to nothing.
+ * The counters are not atomic, so only single-threaded runs are
+ * counted exactly. */
+
+#ifdef SORT_COUNTERS
+
+extern unsigned long long sort_comparisons;
+extern unsigned long long sort_moves;
+
+#define COUNT_COMPARISON() (++sort_comparisons)
+#define COUNT_MOVES(n) (sort_moves += (n))
+
+#else
+
+#define COUNT_COMPARISON() ((void) 0)
+#define COUNT_MOVES(n) ((void) 0)
+
+#endif
+
+#define COUNT_MOVE() COUNT_MOVES(1)
+
+#endif
@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "topkheap.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Prints the k largest unsigned 64-bit decimal keys of its input, one
+ * per line, largest first. Each file argument is a shard: it is mapped
+ * into memory and selected on its own, and the shard selections are
+ * then merged. Standard input ("-", or no files) is read through a
+ * buffer instead. Since the output is itself a key file, results for
+ * shards produced elsewhere can be merged by running topk over them. */
+
+#define DEFAULT_K 10
+#define READ_BUFFER_SIZE (1 << 20)
+
+/* Parses the keys in text[0..length) into selection. A key may be
+ * split across calls; *partial carries its digits so far and
+ * *in_key whether one is in progress. Exits on a key too large for 64
+ * bits, as extsort does. */
+static void select_keys(topk *selection, const char *text, size_t length, uint64_t *partial, int *in_key)
+{
+    uint64_t key = *partial;
+    int reading = *in_key;
+
+    for (const char *c = text; c != text + length; ++c) {
+        if (*c >= '0' && *c <= '9') {
+            const unsigned digit = *c - '0';
+            if (key > (UINT64_MAX - digit) / 10) {
+                fprintf(stderr, "topk: key exceeds %" PRIu64 "\n", UINT64_MAX);
+                exit(EXIT_FAILURE);
+            }
+            key = key * 10 + digit;
+            reading = 1;
+        }
+        else if (reading) {
+            topk_add(selection, key);
+            key = 0;
+            reading = 0;
+        }
+    }
+
+    *partial = key;
+    *in_key = reading;
+}
+
+static void finish_keys(topk *selection, uint64_t partial, int in_key)
+{
+    if (in_key)
+        topk_add(selection, partial);
+}
+
+/* Selects from a file by mapping it. Returns 0 on success. */
+static int select_file(topk *selection, const char *path)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    uint64_t partial = 0;
+    int in_key = 0;
+
+    if (info.st_size > 0) {
+        char *text = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+
+        posix_madvise(text, info.st_size, POSIX_MADV_SEQUENTIAL);
+        select_keys(selection, text, info.st_size, &partial, &in_key);
+        munmap(text, info.st_size);
+    }
+
+    close(fd);
+    finish_keys(selection, partial, in_key);
+    return 0;
+}
+
+/* Selects from a stream that cannot be mapped. Returns 0 on success. */
+static int select_stream(topk *selection, FILE *in)
+{
+    char *buffer = malloc(READ_BUFFER_SIZE);
+    if (buffer == NULL) {
+        perror("topk");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t partial = 0;
+    int in_key = 0;
+    size_t length;
+
+    while ((length = fread(buffer, 1, READ_BUFFER_SIZE, in)) > 0)
+        select_keys(selection, buffer, length, &partial, &in_key);
+
+    finish_keys(selection, partial, in_key);
+    free(buffer);
+
+    if (ferror(in)) {
+        perror("topk");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Parses a count of at least 1 that topk_init can allocate for.
+ * Returns 0 on success. */
+static int parse_count(const char *text, size_t *k)
+{
+    if (text[0] < '0' || text[0] > '9')
+        return -1;
+
+    char *end;
+    errno = 0;
+    const unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || *end != '\0' || value == 0 || value >= SIZE_MAX / sizeof(uint64_t))
+        return -1;
+
+    *k = value;
+    return 0;
+}
+
+int main(int argc, char **argv){
+
+    size_t k = DEFAULT_K;
+    int option;
+
+    while ((option = getopt(argc, argv, "k:")) != -1) {
+        if (option != 'k' || parse_count(optarg, &k) != 0) {
+            fprintf(stderr, "Usage: %s [-k count] [file ...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    topk selection;
+    topk_init(&selection, k);
+    int status = EXIT_SUCCESS;
+
+    if (optind == argc && select_stream(&selection, stdin) != 0)
+        status = EXIT_FAILURE;
+
+    for (int index = optind; index < argc; ++index) {
+        topk shard;
+        topk_init(&shard, k);
+
+        int result;
+        if (strcmp(argv[index], "-") == 0)
+            result = select_stream(&shard, stdin);
+        else
+            result = select_file(&shard, argv[index]);
+
+        if (result != 0)
+            status = EXIT_FAILURE;
+
+        topk_merge(&selection, &shard);
+        topk_free(&shard);
+    }
+
+    size_t count;
+    const uint64_t *keys = topk_finish(&selection, &count);
+    for (size_t index = 0; index < count; ++index)
+        printf("%llu\n", (unsigned long long) keys[index]);
+
+    topk_free(&selection);
+    return status;
+}
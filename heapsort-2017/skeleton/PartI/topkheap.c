@@ -0,0 +1,87 @@
+#include "topkheap.h"
+#include "dheap.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TOPK_ARITY 4
+
+/* Reversed so that the dheap max-heap keeps the smallest key on top */
+static int compare_reversed(const void *a, const void *b)
+{
+    const uint64_t key1 = *(const uint64_t *) a;
+    const uint64_t key2 = *(const uint64_t *) b;
+
+    return (key1 < key2) - (key1 > key2);
+}
+
+static void selection_heap(struct dheap *heap, topk *selection)
+{
+    dheap_init(heap, selection->keys, sizeof(uint64_t), TOPK_ARITY, &compare_reversed);
+}
+
+
+/*initialise an empty selection of the k largest keys*/
+
+void topk_init(topk *selection, size_t k)
+{
+    assert(selection != NULL);
+
+    if (k >= SIZE_MAX / sizeof(uint64_t)) {
+        fprintf(stderr, "topk_init: %zu keys is too many\n", k);
+        exit(EXIT_FAILURE);
+    }
+
+    selection->k = k;
+    selection->count = 0;
+    selection->keys = malloc((k + 1) * sizeof(uint64_t));
+    if (selection->keys == NULL) {
+        perror("topk_init");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*free the memory allocated by the selection*/
+
+void topk_free(topk *selection)
+{
+    free(selection->keys);
+}
+
+/*offer a key to the selection*/
+
+void topk_add(topk *selection, uint64_t key)
+{
+    struct dheap heap;
+
+    if (selection->count < selection->k) {
+        selection->keys[selection->count] = key;
+        selection_heap(&heap, selection);
+        dheap_sift_up(&heap, selection->count++);
+    }
+    else if (selection->count > 0 && key > selection->keys[0]) {
+        selection->keys[0] = key;
+        selection_heap(&heap, selection);
+        dheap_sift_down(&heap, 0, selection->count);
+    }
+}
+
+/*add every key kept by shard to selection*/
+
+void topk_merge(topk *selection, const topk *shard)
+{
+    for (size_t index = 0; index < shard->count; ++index)
+        topk_add(selection, shard->keys[index]);
+}
+
+/*sort the kept keys into descending order and return them*/
+
+const uint64_t *topk_finish(topk *selection, size_t *count)
+{
+    struct dheap heap;
+    selection_heap(&heap, selection);
+    dheap_sort_heap(&heap, selection->count);
+
+    *count = selection->count;
+    return selection->keys;
+}
@@ -0,0 +1,36 @@
+#ifndef _TOPKHEAP_H_
+#define _TOPKHEAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Keeps the k largest keys seen in a stream. The keys are held in a
+ * min-heap of at most k entries, so memory is O(k) and each key costs
+ * one comparison with the smallest kept key, plus O(log k) if it
+ * displaces it. Selections over separate shards of a stream can be
+ * merged into the selection over the whole stream. */
+
+typedef struct topk_t topk;
+
+struct topk_t{
+ uint64_t *keys;
+ size_t k;
+ size_t count;
+};
+
+/*initialise an empty selection of the k largest keys*/
+void topk_init(topk *selection, size_t k);
+
+/*free the memory allocated by the selection*/
+void topk_free(topk *selection);
+
+/*offer a key to the selection*/
+void topk_add(topk *selection, uint64_t key);
+
+/*add every key kept by shard to selection, which then holds the k largest of both*/
+void topk_merge(topk *selection, const topk *shard);
+
+/*sort the kept keys into descending order and return them; no more keys may be added afterwards*/
+const uint64_t *topk_finish(topk *selection, size_t *count);
+
+#endif
@@ -1,10 +1,10 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
 char *derived_lookup_table(char *);
-int contains(char *, char );
 
 int main(void) {
   
@@ -15,48 +15,40 @@ int main(void) {
     char *table = derived_lookup_table(s);
   
     printf("Derived lookup table: %s\n\n", table);
+
+    free(table);
     
     return EXIT_SUCCESS;
 }
 
+// Each character of s once, in order of first occurrence
+
 char *derived_lookup_table(char *s) {
 
-	char * o_out = malloc(sizeof(s));
-	
-        if (o_out == NULL) {
-	    perror("malloc");
-	    exit(EXIT_FAILURE);
-	}
+	uint64_t seen[256 / 64] = { 0 };
+	char unique[256];
+	size_t count = 0;
 
-	char * o_end = malloc(sizeof(s));
-          
-        o_end = o_out;
+	for ( ; *s != '\0' ; ++s) {
+	    const unsigned char c = *s;
+	    const uint64_t bit = UINT64_C(1) << (c % 64);
 
-        for ( ; *s != '\0' ; ++s) {
-	    if (!contains(o_out, *s)) {
-	      *o_end++ = *s;
+	    if (!(seen[c / 64] & bit)) {
+	      seen[c / 64] |= bit;
+	      unique[count++] = *s;
 	    }
 	}
-   
-   	char *out = realloc(out, o_end - o_out + 1);
+
+	char *out = malloc(count + 1);
 
 	if (out == NULL) {
-	    perror("realloc");
+	    perror("malloc");
 	    exit(EXIT_FAILURE);
-	  }
-
-	return out;
+	}
 
-}
+	memcpy(out, unique, count);
+	out[count] = '\0';
 
+	return out;
 
-int contains(char *s, char c) {
-    
-    for (int i=0; i< strlen(s); i++){
-        if(s[i] == c){
-	   return 1;
-	}
-    }
-    
-    return 0;
 }
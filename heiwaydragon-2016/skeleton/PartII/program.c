@@ -1,10 +1,10 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 char *CopyUniqueLettersPtr(const char *, int );
 int *printIntPtr(int *, long );
-int contains(const char *, char );
 
 int main(void)
 {
@@ -24,43 +24,33 @@ int main(void)
 }
 
 
-// Returns 1 if character c is contained in string s, returns 0 otherwise.
-
-int contains(const char *s, const char c)
-{
-  for (int i = 0; i < strlen(s); ++i)
-  {
-    if(s[i] == c)
-    {
-      return 1;
-    }
-  }
-  return 0;
-}
-
 //Copy unique number of characters from a string
 
 char *CopyUniqueLettersPtr(const char *src, int number_letters)
 {
-  char *temp = calloc(strlen(src) + 1, sizeof(char));
-  if (temp == NULL)
-  {
-    perror("calloc");
-    exit(EXIT_FAILURE);
-  }
+  uint64_t seen[256 / 64] = { 0 };
+  char unique[256];
+  size_t count = 0;
 
-  char *dst = temp;
   for (int i = 0; *src != '\0' && i < number_letters; ++i, ++src)
   {
-    if (!contains(temp, *src))
+    const unsigned char c = *src;
+    const uint64_t bit = UINT64_C(1) << (c % 64);
+    if (!(seen[c / 64] & bit))
     {
-      *dst++=*src;
+      seen[c / 64] |= bit;
+      unique[count++] = *src;
     }
   }
-  int dst_length = dst - temp + 1;
-  dst = malloc(dst - temp + 1);
-  strncpy(dst, temp, dst_length);
-  free(temp);
+
+  char *dst = malloc(count + 1);
+  if (dst == NULL)
+  {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(dst, unique, count);
+  dst[count] = '\0';
   return dst;
 }
 
@@ -0,0 +1,52 @@
+#include <pthread.h>
+
+#include "crc32.h"
+
+/*
+ * Private function prototypes.
+ */
+
+static void _crc32_init(void);
+
+static uint32_t crc32_table[4][256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Fills the tables for processing four bytes at a time ("slicing by 4").
+ */
+static void _crc32_init(void) {
+  for (uint32_t byte = 0; byte < 256; byte++) {
+    uint32_t crc = byte;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? crc >> 1 ^ 0xEDB88320u : crc >> 1;
+    }
+    crc32_table[0][byte] = crc;
+  }
+
+  for (uint32_t byte = 0; byte < 256; byte++) {
+    for (int slice = 1; slice < 4; slice++) {
+      const uint32_t previous = crc32_table[slice - 1][byte];
+      crc32_table[slice][byte] = previous >> 8 ^ crc32_table[0][previous & 0xff];
+    }
+  }
+}
+
+/*
+ * Returns the CRC-32 of the n bytes at data appended to data whose CRC-32
+ * is crc.
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t n) {
+  pthread_once(&crc32_once, _crc32_init);
+
+  crc = ~crc;
+  for (; n >= 4; n -= 4, data += 4) {
+    crc ^= (uint32_t) data[0] | (uint32_t) data[1] << 8 |
+           (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24;
+    crc = crc32_table[3][crc & 0xff] ^ crc32_table[2][crc >> 8 & 0xff] ^
+          crc32_table[1][crc >> 16 & 0xff] ^ crc32_table[0][crc >> 24];
+  }
+  for (; n > 0; n--, data++) {
+    crc = crc >> 8 ^ crc32_table[0][(crc ^ *data) & 0xff];
+  }
+  return ~crc;
+}
@@ -0,0 +1,14 @@
+#ifndef __CRC32_H
+#define __CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The CRC-32 used by zlib and gzip (reflected polynomial 0xEDB88320).
+ * Start with crc = 0 and pass the previous result to continue a checksum
+ * over more data.
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t n);
+
+#endif
@@ -5,13 +5,17 @@
 #include <stdint.h>
 
 #include "exam.h"
+#include "huffcode.h"
 
 /*
  * Private function prototypes.
  */
 
 static void _print_huffman_tree(const huffman_tree_t *, int);
-static void _print_huffman_tree_codes(const huffman_tree_t *, char *, char *);
+static int _huffman_tree_paths(const huffman_tree_t *,
+                               char (*)[MAX_CODE_LENGTH], char *);
+static huffman_tree_list_t *_huffman_tree_list_pop(huffman_tree_list_t **,
+                                                   huffman_tree_list_t **);
 
 /*
  * Prints the given Huffman tree.
@@ -46,42 +50,77 @@ static void _print_huffman_tree(const huffman_tree_t *t, int level) {
 }
 
 /*
- * Prints the codes contained in the given Huffman tree.
+ * Prints the codes of the letters in the given Huffman tree.
  */
 void print_huffman_tree_codes(const huffman_tree_t *t) {
   printf("Huffman tree codes:\n");
 
-  char *code = calloc(MAX_CODE_LENGTH, sizeof(char)), *code_position = code;
-  if (code == NULL) {
-    perror("calloc");
-    exit(EXIT_FAILURE);
-  }
+  char paths[HUFFMAN_SYMBOLS][MAX_CODE_LENGTH], order[HUFFMAN_SYMBOLS];
+  const int leaves = _huffman_tree_paths(t, paths, order);
 
-  _print_huffman_tree_codes(t, code, code_position);
-  free(code);
+  for (int i = 0; i < leaves; i++) {
+    printf("'%c' has code \"%s\"\n", order[i], paths[(uint8_t) order[i]]);
+  }
 }
 
 /*
- * Private helper function for print_huffman_tree_codes.
+ * Private helper function that walks the given Huffman tree without
+ * recursion, writing the path to each leaf as a string of 'L' and 'R'
+ * steps into paths, indexed by letter, and the letters into order from
+ * left to right. Returns the number of leaves. A tree that is a single
+ * leaf gives it the path "L", so that every letter takes a step.
  */
-static void _print_huffman_tree_codes(const huffman_tree_t *t,
-                                      char *code, char *code_position) {
-
-  if (t->left == NULL && t->right == NULL) {
-    printf("'%c' has code \"%s\"\n", t->letter, code);
-  } else if (t->left != NULL) {
-    *code_position++ = 'L';
-    *code_position = '\0';
+static int _huffman_tree_paths(const huffman_tree_t *t,
+                               char (*paths)[MAX_CODE_LENGTH], char *order) {
+  struct {
+    const huffman_tree_t *node;
+    int depth;
+    char step;
+  } stack[HUFFMAN_MAX_NODES];
+  char path[MAX_CODE_LENGTH];
+  int size = 1, leaves = 0;
+
+  stack[0].node = t;
+  stack[0].depth = 0;
+
+  while (size > 0) {
+    const huffman_tree_t *node = stack[--size].node;
+    const int depth = stack[size].depth;
+    if (depth > 0) {
+      path[depth - 1] = stack[size].step;
+    }
 
-    _print_huffman_tree_codes(t->left, code, code_position--);
-  }
+    if (node->left == NULL && node->right == NULL) {
+      char *leaf_path = paths[(uint8_t) node->letter];
+      if (depth == 0) {
+        strcpy(leaf_path, "L");
+      } else {
+        memcpy(leaf_path, path, depth);
+        leaf_path[depth] = '\0';
+      }
+      order[leaves++] = node->letter;
+      continue;
+    }
 
-  if (t->right != NULL) {
-    *code_position++ = 'R';
-    *code_position = '\0';
+    if (depth + 1 >= MAX_CODE_LENGTH || size + 2 > HUFFMAN_MAX_NODES) {
+      fprintf(stderr, "Huffman tree is deeper than %d levels\n",
+              MAX_CODE_LENGTH - 1);
+      exit(EXIT_FAILURE);
+    }
 
-    _print_huffman_tree_codes(t->right, code, code_position--);
+    /* The left child is pushed last so that it is visited first */
+    if (node->right != NULL) {
+      stack[size].node = node->right;
+      stack[size].depth = depth + 1;
+      stack[size++].step = 'R';
+    }
+    if (node->left != NULL) {
+      stack[size].node = node->left;
+      stack[size].depth = depth + 1;
+      stack[size++].step = 'L';
+    }
   }
+  return leaves;
 }
 
 /*
@@ -99,10 +138,19 @@ void print_huffman_tree_list(const huffman_tree_list_t *l) {
  * Frees a Huffman tree.
  */
 void huffman_tree_free(huffman_tree_t *t) {
-  if (t != NULL) {
-    huffman_tree_free(t->left);
-    huffman_tree_free(t->right);
-    free(t);
+  /* Rotates left subtrees up instead of recursing, so that degenerate
+     trees cannot exhaust the stack */
+  while (t != NULL) {
+    if (t->left != NULL) {
+      huffman_tree_t *left = t->left;
+      t->left = left->right;
+      left->right = t;
+      t = left;
+    } else {
+      huffman_tree_t *right = t->right;
+      free(t);
+      t = right;
+    }
   }
 }
 
@@ -110,10 +158,11 @@ void huffman_tree_free(huffman_tree_t *t) {
  * Frees a list of Huffman trees.
  */
 void huffman_tree_list_free(huffman_tree_list_t *l) {
-  if (l != NULL) {
-    huffman_tree_list_free(l->next);
+  while (l != NULL) {
+    huffman_tree_list_t *next = l->next;
     huffman_tree_free(l->tree);
     free(l);
+    l = next;
   }
 }
 
@@ -146,22 +195,26 @@ int frequency(char *s, char c) {
 
 /*
  * Takes a string s and returns a new heap-allocated string containing only the
- * unique characters of s.
- *
- * Pre: all strings will have fewer than or equal to MAX_STRING_LENGTH - 1
- *      characters.
+ * unique characters of s, in the order they first occur.
  */
 char *nub(char *s) {
 	assert(s);
-	char* nub_string = malloc(MAX_STRING_LENGTH - 1);
-	assert(nub_string);
+	uint64_t seen[256 / 64] = {0};
+	char unique[256];
 	uint32_t j = 0;
 	for (uint32_t i = 0; s[i] != '\0'; i++) {
-		if (!contains(nub_string, s[i])) {
-			nub_string[j] = s[i];
+		const unsigned char c = s[i];
+		const uint64_t bit = UINT64_C(1) << (c % 64);
+		if (!(seen[c / 64] & bit)) {
+			seen[c / 64] |= bit;
+			unique[j] = s[i];
 			j++;
 		}
 	}
+	char* nub_string = malloc(j + 1);
+	assert(nub_string);
+	memcpy(nub_string, unique, j);
+	nub_string[j] = '\0';
 	return nub_string;
 }
 
@@ -179,15 +232,13 @@ huffman_tree_list_t *huffman_tree_list_add(huffman_tree_list_t *l, huffman_tree_
 	huffman_tree_list_t *new_list = malloc(sizeof(huffman_tree_list_t));
 	assert(new_list);
 
-	if (l == NULL) {
-		*new_list = (huffman_tree_list_t) {t, NULL};
-	} else if (t->count < l->tree->count) {
-		*new_list = (huffman_tree_list_t) {t, l};
-	} else {
-		*new_list = (huffman_tree_list_t) {l->tree, huffman_tree_list_add(l->next, t)};
-		free(l);
+	huffman_tree_list_t **position = &l;
+	while (*position != NULL && t->count >= (*position)->tree->count) {
+		position = &(*position)->next;
 	}
-	return new_list;
+	*new_list = (huffman_tree_list_t) {t, *position};
+	*position = new_list;
+	return l;
 }
 
 /*
@@ -203,19 +254,57 @@ huffman_tree_list_t *huffman_tree_list_add(huffman_tree_list_t *l, huffman_tree_
 huffman_tree_list_t *huffman_tree_list_build(char *s, char *t) {
 	assert(s);
 	assert(t);
-	huffman_tree_list_t* list = NULL;
+	uint64_t counts[HUFFMAN_SYMBOLS] = {0};
+	huffman_histogram((uint8_t *) s, strlen(s), counts);
+
+	/* Insertion sort keeps letters with equal counts in the order of t */
+	huffman_tree_t *leaves[HUFFMAN_SYMBOLS];
+	uint32_t n = 0;
 	for (uint32_t i = 0; t[i] != '\0'; i++) {
 		huffman_tree_t *tree = malloc(sizeof(huffman_tree_t));
 		assert(tree);
-		*tree = (huffman_tree_t) {frequency(s, t[i]), t[i], NULL, NULL};
-		list = huffman_tree_list_add(list, tree);
+		*tree = (huffman_tree_t) {counts[(uint8_t) t[i]], t[i], NULL, NULL};
+
+		uint32_t j = n++;
+		for (; j > 0 && leaves[j - 1]->count > tree->count; j--) {
+			leaves[j] = leaves[j - 1];
+		}
+		leaves[j] = tree;
+	}
+
+	huffman_tree_list_t *list = NULL;
+	while (n > 0) {
+		huffman_tree_list_t *new_list = malloc(sizeof(huffman_tree_list_t));
+		assert(new_list);
+		*new_list = (huffman_tree_list_t) {leaves[--n], list};
+		list = new_list;
 	}
 	return list;
 }
 
+/*
+ * Private helper function for huffman_tree_list_reduce. Unlinks and returns
+ * the lighter head of the two queues, preferring the leaves on a tie.
+ */
+static huffman_tree_list_t *_huffman_tree_list_pop(huffman_tree_list_t **leaves,
+                                                   huffman_tree_list_t **merged) {
+	huffman_tree_list_t **queue = merged;
+	if (*leaves != NULL && (*merged == NULL || (*leaves)->tree->count <= (*merged)->tree->count)) {
+		queue = leaves;
+	}
+
+	huffman_tree_list_t *head = *queue;
+	*queue = head->next;
+	return head;
+}
+
 /*
  * Reduces a sorted list of Huffman trees to a single element.
  *
+ * Merged trees are made in nondecreasing order of count, so rather than
+ * inserting each into the sorted list they are queued in a second list,
+ * and the two lightest trees are always at the heads of the two lists.
+ *
  * Pre:   The list l is non-empty and sorted according to the frequency counts
  *        of the trees it contains.
  *
@@ -224,50 +313,64 @@ huffman_tree_list_t *huffman_tree_list_build(char *s, char *t) {
 huffman_tree_list_t *huffman_tree_list_reduce(huffman_tree_list_t *l) {
 	assert(l);
 	assert(l->tree);
-	if (l->next == NULL) {
-		return l;
-	}
-	huffman_tree_t* new_tree = malloc(sizeof(huffman_tree_t));
-	assert(new_tree);
-	*new_tree = (huffman_tree_t) {l->tree->count + l->next->tree->count, '\0', l->tree, l->next->tree};
-	huffman_tree_list_t *new_list = huffman_tree_list_add(l->next->next, new_tree);
-	free(l->next);
-	free(l);
-	return huffman_tree_list_reduce(new_list);
-}
-
-char *build_encoding(huffman_tree_t *t, uint32_t encoding_position, char current) {
-	if (t->left == NULL && t->right == NULL) {
-		if (t->letter == current) {
+	huffman_tree_list_t *merged = NULL, *merged_tail = NULL;
 
+	while (l != NULL || merged->next != NULL) {
+		huffman_tree_list_t *first = _huffman_tree_list_pop(&l, &merged);
+		if (merged == NULL && l == NULL) {
+			return first;
 		}
-	}
-	if (t->left != NULL) {
-		char *left_pos = build_encoding(t->left, encoding_position, current);
-		if (strlen(left_pos) > 0) {
-
+		huffman_tree_list_t *second = _huffman_tree_list_pop(&l, &merged);
+
+		huffman_tree_t* new_tree = malloc(sizeof(huffman_tree_t));
+		assert(new_tree);
+		*new_tree = (huffman_tree_t) {first->tree->count + second->tree->count, '\0', first->tree, second->tree};
+		free(second);
+
+		*first = (huffman_tree_list_t) {new_tree, NULL};
+		if (merged == NULL) {
+			merged = first;
+		} else {
+			merged_tail->next = first;
 		}
+		merged_tail = first;
 	}
-	if (t->right != NULL) {
-		build_encoding(t->right, encoding_position, current);
-	}
-	return NULL; 
+	return merged;
 }
 
 /*
  * Accepts a Huffman tree t and a string s and returns a new heap-allocated
  * string containing the encoding of s as per the tree t.
  *
+ * The code of each letter is its canonical code (see huffcode.h), looked
+ * up in a table rather than found by walking the tree, with 'L' for a 0
+ * bit and 'R' for a 1 bit.
+ *
  * Pre: s only contains characters present in the tree t.
  */
 char *huffman_tree_encode(huffman_tree_t *t, char *s) {
-	char *encoding; // = malloc(MAX_CODE_LENGTH - 1);
-	// uint32_t curr_position = 0;
+	assert(t);
+	assert(s);
+	char paths[HUFFMAN_SYMBOLS][MAX_CODE_LENGTH], order[HUFFMAN_SYMBOLS];
+	_huffman_tree_paths(t, paths, order);
+
+	size_t length = 1;
+	for (size_t i = 0; s[i] != '\0'; i++) {
+		length += strlen(paths[(uint8_t) s[i]]);
+	}
+
+	char *encoding = malloc(length);
 	assert(encoding);
-	for (uint32_t i = 0; s[i] != '\0'; i++) {
-		build_encoding(t, 0, s[i]);
+
+	char *position = encoding;
+	for (size_t i = 0; s[i] != '\0'; i++) {
+		const char *path = paths[(uint8_t) s[i]];
+		const size_t path_length = strlen(path);
+		memcpy(position, path, path_length);
+		position += path_length;
 	}
-	return NULL;
+	*position = '\0';
+	return encoding;
 }
 
 /*
@@ -277,5 +380,26 @@ char *huffman_tree_encode(huffman_tree_t *t, char *s) {
  * Pre: the code given is decodable using the supplied tree t.
  */
 char *huffman_tree_decode(huffman_tree_t *t, char *code) {
-  return NULL;
+	assert(t);
+	assert(code);
+	/* Every letter takes at least one step */
+	char *decoding = malloc(strlen(code) + 1);
+	assert(decoding);
+
+	const int single_leaf = t->left == NULL && t->right == NULL;
+	const huffman_tree_t *node = t;
+	size_t decoded = 0;
+	for (size_t i = 0; code[i] != '\0'; i++) {
+		if (!single_leaf) {
+			node = code[i] == 'L' ? node->left : node->right;
+			assert(node);
+		}
+		if (node->left == NULL && node->right == NULL) {
+			decoding[decoded++] = node->letter;
+			node = t;
+		}
+	}
+	assert(node == t);
+	decoding[decoded] = '\0';
+	return decoding;
 }
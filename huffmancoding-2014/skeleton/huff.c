@@ -0,0 +1,801 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "huffcode.h"
+
+/*
+ * huff: compresses or decompresses a file with canonical Huffman codes.
+ *
+ * The input is cut into independent blocks of at most block size bytes,
+ * each coded with its own code, so memory use depends only on the block
+ * size and not on the size of the file. Blocks are compressed or
+ * decompressed by a pool of threads (one per processor by default) and
+ * written out in order. All integers are big-endian.
+ *
+ *   file:   "HUF1" block-size:4 block* end
+ *   block:  mode:1 raw-size:4 payload-size:4 crc32:4 payload
+ *   end:    a stored block with raw size 0
+ *
+ * A Huffman block (mode 1) starts its payload with a 32-byte bitmap of
+ * the byte values present, followed by the code length of each of them
+ * in increasing order, followed by the packed codes. Blocks of at least
+ * HUFF_STREAMS_MIN_SIZE bytes are coded as four interleaved streams
+ * instead (mode 2, see huffman_encode4), which decode faster. A block
+ * that would not shrink is stored as is (mode 0). The CRC-32 covers the
+ * raw bytes.
+ *
+ * With -s, huff compresses a live stream such as a pipe or socket in one
+ * pass instead: each block is whatever input is available, up to the
+ * block size (DEFAULT_STREAM_BLOCK_SIZE unless -b is given), and it is
+ * written and flushed at once. Blocks are coded with an adaptive model
+ * (see huffman_model_t) that both ends rebuild from the blocks before,
+ * so no code lengths are sent (modes 3 and 4, the payload being only the
+ * packed codes). Such files are decompressed one block at a time, in
+ * order, each written as soon as it is decoded:
+ *
+ *   stream: "HUFS" block-size:4 max-code-length:1 block* end
+ *
+ * Codes are limited to DEFAULT_MAX_LENGTH bits unless -l says otherwise
+ * (-l 0 for plain Huffman codes), so that the decoder finds every code in
+ * its lookup table. -v reports the compression ratio and speed.
+ */
+
+#define HUFF_MAGIC "HUF1"
+#define HUFF_STREAM_MAGIC "HUFS"
+#define HUFF_MAGIC_SIZE 4
+#define HUFF_FILE_HEADER_SIZE (HUFF_MAGIC_SIZE + 4)
+#define HUFF_BLOCK_HEADER_SIZE 13
+#define HUFF_BITMAP_SIZE (HUFFMAN_SYMBOLS / 8)
+#define HUFF_TABLE_MAX_SIZE (HUFF_BITMAP_SIZE + HUFFMAN_SYMBOLS)
+
+enum { HUFF_STORED = 0, HUFF_HUFFMAN = 1, HUFF_HUFFMAN4 = 2 };
+enum { HUFF_ADAPTIVE = 3, HUFF_ADAPTIVE4 = 4 };
+
+enum { HUFF_STREAMS_MIN_SIZE = 4096 };
+
+enum { DEFAULT_BLOCK_SIZE = 1 << 20 };
+enum { DEFAULT_STREAM_BLOCK_SIZE = 1 << 16 };
+enum { MAX_BLOCK_SIZE = 1 << 26 };
+enum { MAX_THREADS = 256 };
+enum { DEFAULT_MAX_LENGTH = HUFFMAN_LOOKUP_BITS };
+
+typedef struct huff_block {
+  uint8_t mode;
+  uint32_t raw_size;
+  uint32_t payload_size;
+  uint32_t crc;
+} huff_block_t;
+
+/*
+ * A block on its way through the pool. The reader fills raw (or payload,
+ * when decompressing), a worker produces the other, and the writer writes
+ * it out once done is set.
+ */
+typedef struct huff_job {
+  huff_block_t block;
+  uint8_t *raw, *payload;
+  huffman_decoder_t decoder;
+  const char *error;
+  int done;
+} huff_job_t;
+
+/*
+ * The jobs form a ring. Jobs are submitted, started and written in order
+ * of their sequence number, and job n lives in slot n % job_count.
+ */
+typedef struct huff_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t ready, done;
+  huff_job_t *jobs;
+  int job_count, thread_count, decompressing, streaming, stopping, max_length;
+  uint32_t block_size;
+  unsigned long submitted, started;
+  uint64_t raw_bytes, packed_bytes;
+  const char *error;
+} huff_pool_t;
+
+/*
+ * Private function prototypes.
+ */
+
+static void put_u32(uint8_t *, uint32_t);
+static uint32_t get_u32(const uint8_t *);
+static int write_block(FILE *, const huff_block_t *, const uint8_t *);
+static size_t read_fully(FILE *, uint8_t *, size_t);
+static size_t encode_table(const uint8_t *, uint8_t *);
+static long decode_table(const uint8_t *, size_t, uint8_t *);
+static void compress_block(huff_job_t *, int, const huffman_model_t *);
+static const char *decompress_block(huff_job_t *, const huffman_model_t *);
+static void *run_worker(void *);
+static int read_raw_block(huff_pool_t *, FILE *, huff_job_t *);
+static int read_stream_block(huff_pool_t *, FILE *, huff_job_t *);
+static int read_packed_block(huff_pool_t *, FILE *, huff_job_t *);
+static int write_job(huff_pool_t *, FILE *, const huff_job_t *);
+static int run_pool(huff_pool_t *, FILE *, FILE *);
+static int run_stream(huff_pool_t *, FILE *, FILE *);
+static int pool_init(huff_pool_t *, int, uint32_t, int);
+static void pool_free(huff_pool_t *);
+static void report(const huff_pool_t *, double);
+static double now(void);
+static int compress(FILE *, FILE *, uint32_t, int, int, int, int);
+static int decompress(FILE *, FILE *, int, int);
+static void usage(const char *);
+
+static void put_u32(uint8_t *p, uint32_t value) {
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+         (uint32_t) p[2] << 8 | p[3];
+}
+
+/*
+ * Writes a block header and its payload. Returns 0 on success.
+ */
+static int write_block(FILE *out, const huff_block_t *block,
+                       const uint8_t *payload) {
+  uint8_t header[HUFF_BLOCK_HEADER_SIZE];
+  header[0] = block->mode;
+  put_u32(header + 1, block->raw_size);
+  put_u32(header + 5, block->payload_size);
+  put_u32(header + 9, block->crc);
+
+  if (fwrite(header, 1, sizeof(header), out) != sizeof(header) ||
+      fwrite(payload, 1, block->payload_size, out) != block->payload_size) {
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Reads up to n bytes, stopping early only at the end of the input.
+ */
+static size_t read_fully(FILE *in, uint8_t *buffer, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    const size_t got = fread(buffer + done, 1, n - done, in);
+    if (got == 0) {
+      break;
+    }
+    done += got;
+  }
+  return done;
+}
+
+/*
+ * Writes the code lengths as a bitmap of the symbols present followed by
+ * their lengths, and returns the number of bytes written.
+ */
+static size_t encode_table(const uint8_t *lengths, uint8_t *out) {
+  size_t size = HUFF_BITMAP_SIZE;
+  memset(out, 0, HUFF_BITMAP_SIZE);
+
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    if (lengths[symbol] > 0) {
+      out[symbol / 8] |= 1 << (symbol % 8);
+      out[size++] = lengths[symbol];
+    }
+  }
+  return size;
+}
+
+/*
+ * Reads code lengths written by encode_table from the n bytes at in.
+ * Returns the number of bytes used, or -1 if they are malformed.
+ */
+static long decode_table(const uint8_t *in, size_t n, uint8_t *lengths) {
+  if (n < HUFF_BITMAP_SIZE) {
+    return -1;
+  }
+
+  size_t size = HUFF_BITMAP_SIZE;
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    lengths[symbol] = 0;
+    if (in[symbol / 8] & 1 << (symbol % 8)) {
+      if (size == n || in[size] == 0) {
+        return -1;
+      }
+      lengths[symbol] = in[size++];
+    }
+  }
+  return size;
+}
+
+/*
+ * Compresses job->raw into job->payload, or leaves it to be stored. Codes
+ * are limited to max_length bits unless it is 0. With a model the block is
+ * coded with the model's code and no table; otherwise it gets its own.
+ */
+static void compress_block(huff_job_t *job, int max_length,
+                           const huffman_model_t *model) {
+  huff_block_t *block = &job->block;
+  block->crc = crc32_update(0, job->raw, block->raw_size);
+  block->mode = HUFF_STORED;
+  block->payload_size = block->raw_size;
+  if (block->raw_size == 0) {
+    return;
+  }
+
+  huffman_table_t own_table;
+  const huffman_table_t *table = &own_table;
+  size_t table_size = 0;
+
+  if (model != NULL) {
+    table = &model->table;
+  } else {
+    uint64_t counts[HUFFMAN_SYMBOLS] = {0};
+    uint8_t lengths[HUFFMAN_SYMBOLS];
+    huffman_histogram(job->raw, block->raw_size, counts);
+    const int longest =
+        max_length > 0 ? huffman_limit_lengths(counts, max_length, lengths)
+                       : huffman_build_lengths(counts, lengths);
+
+    /* Trees too deep for the coder fall back to storing the block */
+    if (longest < 0 || huffman_table_init(&own_table, lengths) != 0) {
+      return;
+    }
+    table_size = encode_table(lengths, job->payload);
+  }
+
+  const int streams = block->raw_size >= HUFF_STREAMS_MIN_SIZE;
+  const size_t packed_size =
+      streams ? huffman_encoded_size4(table, job->raw, block->raw_size)
+              : huffman_encoded_size(table, job->raw, block->raw_size);
+
+  if (table_size + packed_size < block->raw_size) {
+    uint8_t *packed = job->payload + table_size;
+    if (streams) {
+      huffman_encode4(table, job->raw, block->raw_size, packed);
+    } else {
+      huffman_encode(table, job->raw, block->raw_size, packed);
+    }
+    if (model != NULL) {
+      block->mode = streams ? HUFF_ADAPTIVE4 : HUFF_ADAPTIVE;
+    } else {
+      block->mode = streams ? HUFF_HUFFMAN4 : HUFF_HUFFMAN;
+    }
+    block->payload_size = table_size + packed_size;
+  }
+}
+
+/*
+ * Decompresses job->payload into job->raw, where stored blocks are read
+ * directly, and checks the result. Adaptive blocks are decoded with the
+ * model. Returns NULL or an error message.
+ */
+static const char *decompress_block(huff_job_t *job,
+                                    const huffman_model_t *model) {
+  const huff_block_t *block = &job->block;
+
+  if (block->mode == HUFF_ADAPTIVE || block->mode == HUFF_ADAPTIVE4) {
+    const int status =
+        block->mode == HUFF_ADAPTIVE4
+            ? huffman_decode4(&model->decoder, job->payload,
+                              block->payload_size, job->raw, block->raw_size)
+            : huffman_decode(&model->decoder, job->payload,
+                             block->payload_size, job->raw, block->raw_size);
+    if (status != 0) {
+      return "corrupt block";
+    }
+  } else if (block->mode != HUFF_STORED) {
+    uint8_t lengths[HUFFMAN_SYMBOLS];
+    const long table_size =
+        decode_table(job->payload, block->payload_size, lengths);
+    if (table_size < 0 || huffman_decoder_init(&job->decoder, lengths) != 0) {
+      return "corrupt block";
+    }
+
+    const uint8_t *packed = job->payload + table_size;
+    const size_t packed_size = block->payload_size - table_size;
+    const int status =
+        block->mode == HUFF_HUFFMAN4
+            ? huffman_decode4(&job->decoder, packed, packed_size, job->raw,
+                              block->raw_size)
+            : huffman_decode(&job->decoder, packed, packed_size, job->raw,
+                             block->raw_size);
+    if (status != 0) {
+      return "corrupt block";
+    }
+  }
+
+  if (crc32_update(0, job->raw, block->raw_size) != block->crc) {
+    return "checksum mismatch";
+  }
+  return NULL;
+}
+
+/*
+ * Worker thread: takes jobs in the order they were submitted until the
+ * pool is stopped and no job is left.
+ */
+static void *run_worker(void *arg) {
+  huff_pool_t *pool = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stopping && pool->started == pool->submitted) {
+      pthread_cond_wait(&pool->ready, &pool->lock);
+    }
+    if (pool->started == pool->submitted) {
+      break;
+    }
+
+    huff_job_t *job = &pool->jobs[pool->started++ % pool->job_count];
+    pthread_mutex_unlock(&pool->lock);
+
+    if (pool->decompressing) {
+      job->error = decompress_block(job, NULL);
+    } else {
+      compress_block(job, pool->max_length, NULL);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/*
+ * Reads the next raw block into job. Returns 1 if there is one, 0 at the
+ * end of the input and -1 on error.
+ */
+static int read_raw_block(huff_pool_t *pool, FILE *in, huff_job_t *job) {
+  job->block.raw_size = read_fully(in, job->raw, pool->block_size);
+
+  if (ferror(in)) {
+    pool->error = strerror(errno);
+    return -1;
+  }
+  return job->block.raw_size > 0;
+}
+
+/*
+ * Reads as much of the next raw block into job as is available, waiting
+ * only for its first byte. Returns 1 if there is one, 0 at the end of the
+ * input and -1 on error.
+ */
+static int read_stream_block(huff_pool_t *pool, FILE *in, huff_job_t *job) {
+  ssize_t got;
+  do {
+    got = read(fileno(in), job->raw, pool->block_size);
+  } while (got < 0 && errno == EINTR);
+
+  if (got < 0) {
+    pool->error = strerror(errno);
+    return -1;
+  }
+  job->block.raw_size = got;
+  return got > 0;
+}
+
+/*
+ * Reads the next compressed block into job. Returns 1 if there is one, 0
+ * at the end block and -1 on error.
+ */
+static int read_packed_block(huff_pool_t *pool, FILE *in, huff_job_t *job) {
+  uint8_t bytes[HUFF_BLOCK_HEADER_SIZE];
+  if (read_fully(in, bytes, sizeof(bytes)) != sizeof(bytes)) {
+    pool->error = ferror(in) ? strerror(errno) : "truncated input";
+    return -1;
+  }
+
+  huff_block_t *block = &job->block;
+  *block = (huff_block_t) {bytes[0], get_u32(bytes + 1), get_u32(bytes + 5),
+                           get_u32(bytes + 9)};
+  if (block->raw_size > pool->block_size ||
+      block->payload_size > HUFF_TABLE_MAX_SIZE + pool->block_size ||
+      (block->mode == HUFF_STORED && block->payload_size != block->raw_size) ||
+      (pool->streaming ? block->mode == HUFF_HUFFMAN ||
+                             block->mode == HUFF_HUFFMAN4
+                       : block->mode > HUFF_HUFFMAN4) ||
+      block->mode > HUFF_ADAPTIVE4) {
+    pool->error = "corrupt block header";
+    return -1;
+  }
+
+  uint8_t *payload = block->mode == HUFF_STORED ? job->raw : job->payload;
+  if (read_fully(in, payload, block->payload_size) != block->payload_size) {
+    pool->error = ferror(in) ? strerror(errno) : "truncated input";
+    return -1;
+  }
+
+  if (block->raw_size == 0) {
+    if (block->crc != 0) {
+      pool->error = "checksum mismatch";
+      return -1;
+    }
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * Writes out a finished job. Returns 0 on success.
+ */
+static int write_job(huff_pool_t *pool, FILE *out, const huff_job_t *job) {
+  const huff_block_t *block = &job->block;
+  pool->raw_bytes += block->raw_size;
+  pool->packed_bytes += HUFF_BLOCK_HEADER_SIZE + block->payload_size;
+
+  if (pool->decompressing) {
+    if (job->error != NULL) {
+      pool->error = job->error;
+      return -1;
+    }
+    if (fwrite(job->raw, 1, block->raw_size, out) != block->raw_size) {
+      pool->error = strerror(errno);
+      return -1;
+    }
+  } else if (write_block(out, block, block->mode == HUFF_STORED
+                                         ? job->raw
+                                         : job->payload) != 0) {
+    pool->error = strerror(errno);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Runs the blocks of in through the pool's workers and writes the results
+ * to out in their original order. This thread does all the I/O: it reads
+ * ahead while a job slot is free and otherwise writes out the oldest job
+ * once it is done, so at most job_count blocks are held at a time.
+ */
+static int run_pool(huff_pool_t *pool, FILE *in, FILE *out) {
+  pthread_t *threads = malloc(pool->thread_count * sizeof(pthread_t));
+  if (threads == NULL) {
+    perror("huff");
+    return -1;
+  }
+
+  int thread_count = 0;
+  for (; thread_count < pool->thread_count; thread_count++) {
+    if (pthread_create(&threads[thread_count], NULL, run_worker, pool) != 0) {
+      break;
+    }
+  }
+  if (thread_count == 0) {
+    pool->error = "cannot start threads";
+  }
+
+  unsigned long written = 0, read = 0;
+  int reading = thread_count > 0;
+
+  while (reading || written < read) {
+    if (reading && read - written < (unsigned long) pool->job_count) {
+      huff_job_t *job = &pool->jobs[read % pool->job_count];
+      const int status = pool->decompressing ? read_packed_block(pool, in, job)
+                                             : read_raw_block(pool, in, job);
+      if (status <= 0) {
+        reading = 0;
+        continue;
+      }
+
+      pthread_mutex_lock(&pool->lock);
+      job->done = 0;
+      pool->submitted = ++read;
+      pthread_cond_signal(&pool->ready);
+      pthread_mutex_unlock(&pool->lock);
+    } else {
+      huff_job_t *job = &pool->jobs[written % pool->job_count];
+
+      pthread_mutex_lock(&pool->lock);
+      while (!job->done) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+      }
+      pthread_mutex_unlock(&pool->lock);
+
+      /* After an error the remaining jobs are only drained */
+      if (pool->error == NULL && write_job(pool, out, job) != 0) {
+        reading = 0;
+      }
+      written++;
+    }
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  return pool->error == NULL ? 0 : -1;
+}
+
+/*
+ * Codes the blocks of in one at a time on this thread, all with one
+ * adaptive model, and writes and flushes each as soon as it is done, so
+ * that no block waits for later input. The model is updated with every
+ * block after it is coded, exactly as the decoder will.
+ */
+static int run_stream(huff_pool_t *pool, FILE *in, FILE *out) {
+  huffman_model_t model;
+  if (huffman_model_init(&model, pool->max_length) != 0) {
+    pool->error = "maximum code length too short for a stream";
+    return -1;
+  }
+
+  huff_job_t *job = &pool->jobs[0];
+  for (;;) {
+    const int status = pool->decompressing ? read_packed_block(pool, in, job)
+                                           : read_stream_block(pool, in, job);
+    if (status <= 0) {
+      break;
+    }
+
+    if (pool->decompressing) {
+      job->error = decompress_block(job, &model);
+    } else {
+      compress_block(job, pool->max_length, &model);
+    }
+
+    if (write_job(pool, out, job) != 0) {
+      break;
+    }
+    if (fflush(out) != 0) {
+      pool->error = strerror(errno);
+      break;
+    }
+    if (huffman_model_update(&model, job->raw, job->block.raw_size) != 0) {
+      pool->error = "cannot rebuild the code";
+      break;
+    }
+  }
+
+  return pool->error == NULL ? 0 : -1;
+}
+
+/*
+ * Sets up a pool of thread_count workers with two jobs each, so that every
+ * worker has a block queued while the previous one is written out.
+ */
+static int pool_init(huff_pool_t *pool, int decompressing, uint32_t block_size,
+                     int thread_count) {
+  *pool = (huff_pool_t) {.decompressing = decompressing,
+                         .block_size = block_size,
+                         .thread_count = thread_count,
+                         .job_count = 2 * thread_count};
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->ready, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  pool->jobs = calloc(pool->job_count, sizeof(huff_job_t));
+  if (pool->jobs == NULL) {
+    return -1;
+  }
+
+  for (int i = 0; i < pool->job_count; i++) {
+    pool->jobs[i].raw = malloc(block_size);
+    pool->jobs[i].payload = malloc(HUFF_TABLE_MAX_SIZE + block_size);
+    if (pool->jobs[i].raw == NULL || pool->jobs[i].payload == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void pool_free(huff_pool_t *pool) {
+  for (int i = 0; pool->jobs != NULL && i < pool->job_count; i++) {
+    free(pool->jobs[i].raw);
+    free(pool->jobs[i].payload);
+  }
+  free(pool->jobs);
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->ready);
+  pthread_cond_destroy(&pool->done);
+}
+
+/*
+ * Prints the sizes, compression ratio and speed of a run to stderr.
+ */
+static void report(const huff_pool_t *pool, double seconds) {
+  const double ratio =
+      pool->raw_bytes > 0 ? (double) pool->packed_bytes / pool->raw_bytes : 0;
+
+  fprintf(stderr, "huff: %llu raw bytes, %llu packed, ratio %.4f, "
+                  "%.1f MB/s of raw data with %d threads\n",
+          (unsigned long long) pool->raw_bytes,
+          (unsigned long long) pool->packed_bytes, ratio,
+          pool->raw_bytes / seconds / 1e6, pool->thread_count);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compress(FILE *in, FILE *out, uint32_t block_size,
+                    int thread_count, int max_length, int streaming,
+                    int verbose) {
+  const double start = now();
+  huff_pool_t pool;
+  if (pool_init(&pool, 0, block_size, streaming ? 1 : thread_count) != 0) {
+    perror("huff");
+    pool_free(&pool);
+    return -1;
+  }
+  pool.max_length = max_length;
+  pool.streaming = streaming;
+
+  uint8_t header[HUFF_FILE_HEADER_SIZE];
+  memcpy(header, streaming ? HUFF_STREAM_MAGIC : HUFF_MAGIC, HUFF_MAGIC_SIZE);
+  put_u32(header + HUFF_MAGIC_SIZE, block_size);
+  const uint8_t length_byte = max_length;
+  if (fwrite(header, 1, sizeof(header), out) != sizeof(header) ||
+      (streaming && (fwrite(&length_byte, 1, 1, out) != 1 ||
+                     fflush(out) != 0))) {
+    pool.error = strerror(errno);
+  }
+
+  if (pool.error == NULL && (streaming ? run_stream(&pool, in, out)
+                                       : run_pool(&pool, in, out)) == 0) {
+    const huff_block_t end = {HUFF_STORED, 0, 0, 0};
+    if (write_block(out, &end, header) != 0) {
+      pool.error = strerror(errno);
+    }
+  }
+
+  if (pool.error != NULL) {
+    fprintf(stderr, "huff: %s\n", pool.error);
+  } else if (verbose) {
+    report(&pool, now() - start);
+  }
+
+  const int status = pool.error == NULL ? 0 : -1;
+  pool_free(&pool);
+  return status;
+}
+
+static int decompress(FILE *in, FILE *out, int thread_count, int verbose) {
+  const double start = now();
+  uint8_t header[HUFF_FILE_HEADER_SIZE];
+  if (read_fully(in, header, sizeof(header)) != sizeof(header)) {
+    fprintf(stderr, "huff: not a huff file\n");
+    return -1;
+  }
+
+  const int streaming =
+      memcmp(header, HUFF_STREAM_MAGIC, HUFF_MAGIC_SIZE) == 0;
+  if (!streaming && memcmp(header, HUFF_MAGIC, HUFF_MAGIC_SIZE) != 0) {
+    fprintf(stderr, "huff: not a huff file\n");
+    return -1;
+  }
+
+  const uint32_t block_size = get_u32(header + HUFF_MAGIC_SIZE);
+  if (block_size == 0 || block_size > MAX_BLOCK_SIZE) {
+    fprintf(stderr, "huff: bad block size %u\n", (unsigned) block_size);
+    return -1;
+  }
+
+  /* The stream's model must be built exactly as the encoder's was */
+  uint8_t max_length = 0;
+  if (streaming && (read_fully(in, &max_length, 1) != 1 ||
+                    max_length > HUFFMAN_MAX_CODE_LENGTH)) {
+    fprintf(stderr, "huff: bad stream header\n");
+    return -1;
+  }
+
+  huff_pool_t pool;
+  if (pool_init(&pool, 1, block_size, streaming ? 1 : thread_count) != 0) {
+    perror("huff");
+    pool_free(&pool);
+    return -1;
+  }
+  pool.streaming = streaming;
+  pool.max_length = max_length;
+
+  if ((streaming ? run_stream(&pool, in, out) : run_pool(&pool, in, out)) !=
+      0) {
+    fprintf(stderr, "huff: %s\n", pool.error);
+  } else if (verbose) {
+    report(&pool, now() - start);
+  }
+
+  const int status = pool.error == NULL ? 0 : -1;
+  pool_free(&pool);
+  return status;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s -c|-d [-v] [-s] [-b block-size] [-t threads] "
+          "[-l max-code-length] [input [output]]\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  int decompressing = -1;
+  long block_size = 0;
+  long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+  long max_length = DEFAULT_MAX_LENGTH;
+  int streaming = 0, verbose = 0;
+  int option;
+
+  while ((option = getopt(argc, argv, "cdsvb:t:l:")) != -1) {
+    switch (option) {
+    case 'c':
+      decompressing = 0;
+      break;
+    case 'd':
+      decompressing = 1;
+      break;
+    case 's':
+      streaming = 1;
+      break;
+    case 'b':
+      block_size = strtol(optarg, NULL, 10);
+      if (block_size == 0) {
+        block_size = -1;
+      }
+      break;
+    case 't':
+      thread_count = strtol(optarg, NULL, 10);
+      break;
+    case 'l':
+      max_length = strtol(optarg, NULL, 10);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (block_size == 0) {
+    block_size = streaming ? DEFAULT_STREAM_BLOCK_SIZE : DEFAULT_BLOCK_SIZE;
+  }
+
+  if (decompressing < 0 || block_size <= 0 || block_size > MAX_BLOCK_SIZE ||
+      thread_count <= 0 || thread_count > MAX_THREADS || max_length < 0 ||
+      max_length > HUFFMAN_MAX_CODE_LENGTH || argc - optind > 2) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *in = stdin, *out = stdout;
+  if (optind < argc && (in = fopen(argv[optind], "rb")) == NULL) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if (optind + 1 < argc && (out = fopen(argv[optind + 1], "wb")) == NULL) {
+    perror(argv[optind + 1]);
+    return EXIT_FAILURE;
+  }
+
+  int status = decompressing
+                   ? decompress(in, out, thread_count, verbose)
+                   : compress(in, out, block_size, thread_count, max_length,
+                              streaming, verbose);
+
+  if (fclose(out) != 0 && status == 0) {
+    perror("huff: write");
+    status = -1;
+  }
+  fclose(in);
+
+  return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
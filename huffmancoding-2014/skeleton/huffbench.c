@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "huffcode.h"
+
+/*
+ * huffbench: measures each phase of block compression on the given
+ * files, the way huff runs it on one thread: the histogram, building the
+ * code (lengths, encoding table and decoder), encoding and decoding the
+ * four interleaved streams. Every phase is repeated for at least
+ * MIN_SECONDS and reported in MB/s of raw data, with the compressed
+ * ratio (code length tables included). Each round trip is checked.
+ *
+ * Usage: huffbench [-b block-size] [-l max-code-length] file...
+ */
+
+#define MIN_SECONDS 0.2
+
+enum { DEFAULT_BLOCK_SIZE = 1 << 20 };
+
+typedef struct bench_block {
+  const uint8_t *raw;
+  size_t size;
+  uint64_t counts[HUFFMAN_SYMBOLS];
+  uint8_t lengths[HUFFMAN_SYMBOLS];
+  huffman_table_t table;
+  huffman_decoder_t decoder;
+  uint8_t *packed;
+  size_t packed_size;
+} bench_block_t;
+
+typedef struct bench_file {
+  uint8_t *data, *decoded;
+  size_t size;
+  bench_block_t *blocks;
+  size_t block_count;
+  int max_length;
+} bench_file_t;
+
+typedef int (*bench_phase_t)(bench_file_t *);
+
+/*
+ * Private function prototypes.
+ */
+
+static double now(void);
+static uint8_t *read_file(const char *, size_t *);
+static int run_histogram(bench_file_t *);
+static int run_build(bench_file_t *);
+static int run_encode(bench_file_t *);
+static int run_decode(bench_file_t *);
+static double time_phase(bench_phase_t, bench_file_t *, int *);
+static int bench(const char *, size_t, int);
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Reads a whole file into a new heap-allocated buffer, or returns NULL.
+ */
+static uint8_t *read_file(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  size_t capacity = 1 << 16, used = 0;
+  uint8_t *data = malloc(capacity);
+  while (data != NULL) {
+    used += fread(data + used, 1, capacity - used, file);
+    if (used < capacity) {
+      break;
+    }
+
+    uint8_t *grown = realloc(data, 2 * capacity);
+    if (grown == NULL) {
+      free(data);
+    }
+    data = grown;
+    capacity *= 2;
+  }
+
+  if (data != NULL && ferror(file)) {
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+  *size = used;
+  return data;
+}
+
+static int run_histogram(bench_file_t *f) {
+  for (size_t i = 0; i < f->block_count; i++) {
+    bench_block_t *b = &f->blocks[i];
+    memset(b->counts, 0, sizeof(b->counts));
+    huffman_histogram(b->raw, b->size, b->counts);
+  }
+  return 0;
+}
+
+static int run_build(bench_file_t *f) {
+  for (size_t i = 0; i < f->block_count; i++) {
+    bench_block_t *b = &f->blocks[i];
+    const int longest =
+        f->max_length > 0
+            ? huffman_limit_lengths(b->counts, f->max_length, b->lengths)
+            : huffman_build_lengths(b->counts, b->lengths);
+
+    if (longest < 0 || huffman_table_init(&b->table, b->lengths) != 0 ||
+        huffman_decoder_init(&b->decoder, b->lengths) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int run_encode(bench_file_t *f) {
+  for (size_t i = 0; i < f->block_count; i++) {
+    bench_block_t *b = &f->blocks[i];
+    b->packed_size = huffman_encode4(&b->table, b->raw, b->size, b->packed);
+  }
+  return 0;
+}
+
+static int run_decode(bench_file_t *f) {
+  uint8_t *out = f->decoded;
+  for (size_t i = 0; i < f->block_count; i++) {
+    bench_block_t *b = &f->blocks[i];
+    if (huffman_decode4(&b->decoder, b->packed, b->packed_size, out,
+                        b->size) != 0) {
+      return -1;
+    }
+    out += b->size;
+  }
+  return 0;
+}
+
+/*
+ * Runs a phase until MIN_SECONDS have passed and returns its throughput
+ * in MB/s. Sets *failed if any run fails.
+ */
+static double time_phase(bench_phase_t phase, bench_file_t *f, int *failed) {
+  long runs = 0;
+  const double start = now();
+  double elapsed;
+
+  do {
+    if (phase(f) != 0) {
+      *failed = 1;
+    }
+    runs++;
+    elapsed = now() - start;
+  } while (elapsed < MIN_SECONDS);
+
+  return (double) f->size * runs / elapsed / 1e6;
+}
+
+static int bench(const char *path, size_t block_size, int max_length) {
+  bench_file_t f = {.max_length = max_length};
+  f.data = read_file(path, &f.size);
+  if (f.data == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  f.block_count = (f.size + block_size - 1) / block_size;
+  f.blocks = calloc(f.block_count > 0 ? f.block_count : 1,
+                    sizeof(bench_block_t));
+  f.decoded = malloc(f.size + 1);
+  int failed = f.blocks == NULL || f.decoded == NULL;
+
+  for (size_t i = 0; !failed && i < f.block_count; i++) {
+    bench_block_t *b = &f.blocks[i];
+    b->raw = f.data + i * block_size;
+    b->size = i + 1 < f.block_count ? block_size : f.size - i * block_size;
+  }
+
+  /* Build once to size the packed buffers before timing anything */
+  if (!failed && (run_histogram(&f) != 0 || run_build(&f) != 0)) {
+    fprintf(stderr, "huffbench: %s: codes too long for the coder\n", path);
+    failed = 1;
+  }
+  for (size_t i = 0; !failed && i < f.block_count; i++) {
+    bench_block_t *b = &f.blocks[i];
+    b->packed = malloc(huffman_encoded_size4(&b->table, b->raw, b->size));
+    failed = b->packed == NULL;
+  }
+
+  if (!failed) {
+    const double histogram = time_phase(run_histogram, &f, &failed);
+    const double build = time_phase(run_build, &f, &failed);
+    const double encode = time_phase(run_encode, &f, &failed);
+    const double decode = time_phase(run_decode, &f, &failed);
+
+    /* Each block also stores a bitmap and one length per symbol */
+    size_t compressed = 0;
+    for (size_t i = 0; i < f.block_count; i++) {
+      compressed += f.blocks[i].packed_size + HUFFMAN_SYMBOLS / 8;
+      for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+        compressed += f.blocks[i].lengths[symbol] > 0;
+      }
+    }
+
+    const int correct = !failed && memcmp(f.data, f.decoded, f.size) == 0;
+    printf("%-24s %10zu %8.4f %10.1f %10.1f %10.1f %10.1f  %s\n", path,
+           f.size, f.size > 0 ? (double) compressed / f.size : 0.0,
+           histogram, build, encode, decode, correct ? "ok" : "MISMATCH");
+    fflush(stdout);
+    failed = !correct;
+  }
+
+  for (size_t i = 0; f.blocks != NULL && i < f.block_count; i++) {
+    free(f.blocks[i].packed);
+  }
+  free(f.blocks);
+  free(f.decoded);
+  free(f.data);
+  return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+  long block_size = DEFAULT_BLOCK_SIZE;
+  long max_length = HUFFMAN_LOOKUP_BITS;
+  int option;
+
+  while ((option = getopt(argc, argv, "b:l:")) != -1) {
+    switch (option) {
+    case 'b':
+      block_size = strtol(optarg, NULL, 10);
+      break;
+    case 'l':
+      max_length = strtol(optarg, NULL, 10);
+      break;
+    default:
+      block_size = 0;
+      break;
+    }
+  }
+
+  if (block_size <= 0 || max_length < 0 ||
+      max_length > HUFFMAN_MAX_CODE_LENGTH || optind == argc) {
+    fprintf(stderr, "Usage: %s [-b block-size] [-l max-code-length] file...\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("block size %ld, codes of at most %ld bits%s; speeds in MB/s\n",
+         block_size, max_length, max_length == 0 ? " (unlimited)" : "");
+  printf("%-24s %10s %8s %10s %10s %10s %10s\n", "file", "bytes", "ratio",
+         "histogram", "build", "encode", "decode");
+
+  int status = EXIT_SUCCESS;
+  for (int i = optind; i < argc; i++) {
+    if (bench(argv[i], block_size, max_length) != 0) {
+      status = EXIT_FAILURE;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,839 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "huffcode.h"
+
+/*
+ * Lookup entries pack the code length above the symbol. A zero entry
+ * means the code is longer than HUFFMAN_LOOKUP_BITS.
+ */
+#define LOOKUP_ENTRY(symbol, length) ((uint16_t) ((length) << 8 | (symbol)))
+#define LOOKUP_SYMBOL(entry) ((entry) & 0xff)
+#define LOOKUP_LENGTH(entry) ((entry) >> 8)
+
+/*
+ * Accumulates codes most significant bit first. At most 31 bits are
+ * pending between calls, so a code of up to 32 bits always fits in the
+ * 64-bit buffer.
+ */
+typedef struct bit_writer {
+  uint8_t *out;
+  uint64_t buffer;
+  int bits;
+} bit_writer_t;
+
+/*
+ * Reads codes most significant bit first. The next unread bit is the
+ * top bit of buffer and bits of them are valid; the rest are zero.
+ */
+typedef struct bit_reader {
+  const uint8_t *in, *end;
+  uint64_t buffer;
+  int bits;
+  size_t padding;
+} bit_reader_t;
+
+/*
+ * Private function prototypes.
+ */
+
+static int _compare_weights(const void *, const void *);
+static void _huffman_code_lengths(const huffman_tree_t *, int, uint8_t *);
+static int _canonical_codes(const uint8_t *, uint32_t *, uint16_t *);
+static void put_bits(bit_writer_t *, uint32_t, int);
+static void flush_bits(bit_writer_t *);
+static void refill(bit_reader_t *);
+static inline void refill_fast(bit_reader_t *);
+static inline int decode_fast(const huffman_decoder_t *, bit_reader_t *,
+                              uint8_t *);
+static inline int decode_next(const huffman_decoder_t *, bit_reader_t *,
+                              uint8_t *);
+static int reader_overrun(const bit_reader_t *);
+static void split_streams(size_t, size_t *);
+static void put_u32(uint8_t *, uint32_t);
+static uint32_t get_u32(const uint8_t *);
+static int _huffman_model_rebuild(huffman_model_t *);
+
+/*
+ * Adds the number of occurrences of each byte value in the n bytes at in
+ * to counts, which has HUFFMAN_SYMBOLS entries. Four tables are counted
+ * in turn so that runs of one byte value do not stall on incrementing
+ * the same counter.
+ */
+void huffman_histogram(const uint8_t *in, size_t n, uint64_t *counts) {
+  uint64_t tables[4][HUFFMAN_SYMBOLS];
+  memset(tables, 0, sizeof(tables));
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    tables[0][in[i]]++;
+    tables[1][in[i + 1]]++;
+    tables[2][in[i + 2]]++;
+    tables[3][in[i + 3]]++;
+  }
+  for (; i < n; i++) {
+    tables[0][in[i]]++;
+  }
+
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    counts[symbol] += tables[0][symbol] + tables[1][symbol] +
+                      tables[2][symbol] + tables[3][symbol];
+  }
+}
+
+/*
+ * Private helper function for huffman_build_lengths, ordering packed
+ * (count, symbol) weights.
+ */
+static int _compare_weights(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Builds the Huffman tree for the symbol counts, which has
+ * HUFFMAN_SYMBOLS entries, in the arena, replacing what it held, and
+ * returns the number of leaves. Symbols with a zero count are left out.
+ *
+ * Uses the two-queue method: once the leaves are sorted, the merged
+ * nodes are created in nondecreasing order of weight, so the two
+ * lightest nodes are always at the heads of the leaf queue and the
+ * queue of merged nodes. Leaves win ties, as in huffman_tree_list_reduce.
+ * The leaves take the first slots and every parent comes after its
+ * children, so the root is the last node.
+ *
+ * Pre: the counts add up to less than 2^56.
+ */
+int huffman_arena_build(huffman_arena_t *arena, const uint64_t *counts) {
+  uint64_t leaves[HUFFMAN_SYMBOLS];
+  int n = 0;
+
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    if (counts[symbol] > 0) {
+      leaves[n++] = counts[symbol] << 8 | symbol;
+    }
+  }
+  qsort(leaves, n, sizeof(uint64_t), _compare_weights);
+
+  huffman_node_t *nodes = arena->nodes;
+  for (int i = 0; i < n; i++) {
+    nodes[i] = (huffman_node_t) {leaves[i] >> 8, HUFFMAN_NO_NODE,
+                                 HUFFMAN_NO_NODE, leaves[i] & 0xff};
+  }
+
+  int leaf = 0, merged = n, end = n;
+  while (end < 2 * n - 1) {
+    uint16_t lightest[2];
+    for (int k = 0; k < 2; k++) {
+      if (leaf < n &&
+          (merged == end || nodes[leaf].count <= nodes[merged].count)) {
+        lightest[k] = leaf++;
+      } else {
+        lightest[k] = merged++;
+      }
+    }
+
+    nodes[end++] = (huffman_node_t) {
+        nodes[lightest[0]].count + nodes[lightest[1]].count, lightest[0],
+        lightest[1], 0};
+  }
+
+  arena->size = end;
+  arena->root = end > 0 ? end - 1 : HUFFMAN_NO_NODE;
+  return n;
+}
+
+/*
+ * Stores the depth of every leaf of the arena's tree in lengths, as
+ * huffman_code_lengths does for a huffman_tree_t, and returns the
+ * deepest. Walks down from the root without recursion.
+ */
+int huffman_arena_lengths(const huffman_arena_t *arena, uint8_t *lengths) {
+  uint8_t depth[HUFFMAN_MAX_NODES];
+  int max_length = 0;
+
+  memset(lengths, 0, HUFFMAN_SYMBOLS);
+  if (arena->size == 0) {
+    return 0;
+  } else if (arena->size == 1) {
+    lengths[arena->nodes[0].symbol] = 1;
+    return 1;
+  }
+
+  depth[arena->root] = 0;
+  for (int i = arena->root; i >= 0; i--) {
+    const huffman_node_t *node = &arena->nodes[i];
+
+    if (node->left == HUFFMAN_NO_NODE) {
+      lengths[node->symbol] = depth[i];
+      if (depth[i] > max_length) {
+        max_length = depth[i];
+      }
+    } else {
+      const int d = depth[i] < UINT8_MAX ? depth[i] + 1 : UINT8_MAX;
+      depth[node->left] = depth[node->right] = d;
+    }
+  }
+  return max_length;
+}
+
+/*
+ * Computes Huffman code lengths for the symbol counts, which has
+ * HUFFMAN_SYMBOLS entries, into lengths, and returns the longest. Symbols
+ * with a zero count get length 0, and a lone symbol gets length 1.
+ *
+ * Pre: the counts add up to less than 2^56.
+ */
+int huffman_build_lengths(const uint64_t *counts, uint8_t *lengths) {
+  huffman_arena_t arena;
+  huffman_arena_build(&arena, counts);
+  return huffman_arena_lengths(&arena, lengths);
+}
+
+/*
+ * Computes optimal code lengths of at most max_length bits for the symbol
+ * counts, which has HUFFMAN_SYMBOLS entries, into lengths, and returns the
+ * longest, or -1 if the symbols present do not fit in max_length bits.
+ *
+ * Uses package-merge: level 1 is the leaves sorted by weight, and each
+ * further level merges the leaves with the pairs ("packages") of the
+ * level before. The lightest 2n - 2 items of the last level give the
+ * lengths, each leaf gaining a bit every time it is chosen directly or
+ * inside a chosen package.
+ */
+int huffman_limit_lengths(const uint64_t *counts, int max_length,
+                          uint8_t *lengths) {
+  assert(max_length > 0 && max_length <= HUFFMAN_MAX_CODE_LENGTH);
+
+  uint64_t leaves[HUFFMAN_SYMBOLS];
+  int n = 0;
+
+  memset(lengths, 0, HUFFMAN_SYMBOLS);
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    if (counts[symbol] > 0) {
+      leaves[n++] = counts[symbol] << 8 | symbol;
+    }
+  }
+
+  if (n == 0) {
+    return 0;
+  } else if (n == 1) {
+    lengths[leaves[0] & 0xff] = 1;
+    return 1;
+  } else if (max_length < 8 && n > 1 << max_length) {
+    return -1;
+  }
+
+  qsort(leaves, n, sizeof(uint64_t), _compare_weights);
+
+  /*
+   * kind[level][i] is the leaf index of item i of a level, or -1 for a
+   * package; only the weights of the level being built are kept.
+   */
+  int16_t kind[HUFFMAN_MAX_CODE_LENGTH][2 * HUFFMAN_SYMBOLS];
+  int size[HUFFMAN_MAX_CODE_LENGTH];
+  uint64_t weight[2][2 * HUFFMAN_SYMBOLS];
+
+  for (int i = 0; i < n; i++) {
+    kind[0][i] = i;
+    weight[0][i] = leaves[i] >> 8;
+  }
+  size[0] = n;
+
+  for (int level = 1; level < max_length; level++) {
+    const uint64_t *previous = weight[(level - 1) % 2];
+    uint64_t *current = weight[level % 2];
+    const int packages = size[level - 1] / 2;
+    int leaf = 0, package = 0, count = 0;
+
+    while (leaf < n || package < packages) {
+      const uint64_t package_weight =
+          package < packages
+              ? previous[2 * package] + previous[2 * package + 1]
+              : UINT64_MAX;
+
+      if (leaf < n && leaves[leaf] >> 8 <= package_weight) {
+        kind[level][count] = leaf;
+        current[count++] = leaves[leaf++] >> 8;
+      } else {
+        kind[level][count] = -1;
+        current[count++] = package_weight;
+        package++;
+      }
+    }
+    size[level] = count;
+  }
+
+  /* Walk back from the last level, expanding chosen packages */
+  int chosen = 2 * n - 2;
+  for (int level = max_length - 1; level >= 0; level--) {
+    int packages = 0;
+    for (int i = 0; i < chosen; i++) {
+      if (kind[level][i] < 0) {
+        packages++;
+      } else {
+        lengths[leaves[kind[level][i]] & 0xff]++;
+      }
+    }
+    chosen = 2 * packages;
+  }
+
+  int longest = 0;
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    if (lengths[symbol] > longest) {
+      longest = lengths[symbol];
+    }
+  }
+  return longest;
+}
+
+/*
+ * Stores the depth of every leaf of the tree t in lengths, which has
+ * HUFFMAN_SYMBOLS entries; symbols not in the tree get 0. A tree that is
+ * a single leaf gets a one-bit code.
+ */
+void huffman_code_lengths(const huffman_tree_t *t, uint8_t *lengths) {
+  assert(t);
+  memset(lengths, 0, HUFFMAN_SYMBOLS);
+
+  if (t->left == NULL && t->right == NULL) {
+    lengths[(uint8_t) t->letter] = 1;
+  } else {
+    _huffman_code_lengths(t, 0, lengths);
+  }
+}
+
+/*
+ * Private helper function for huffman_code_lengths.
+ */
+static void _huffman_code_lengths(const huffman_tree_t *t, int depth,
+                                  uint8_t *lengths) {
+  if (t->left == NULL && t->right == NULL) {
+    lengths[(uint8_t) t->letter] = depth > UINT8_MAX ? UINT8_MAX : depth;
+    return;
+  }
+
+  if (t->left != NULL) {
+    _huffman_code_lengths(t->left, depth + 1, lengths);
+  }
+
+  if (t->right != NULL) {
+    _huffman_code_lengths(t->right, depth + 1, lengths);
+  }
+}
+
+/*
+ * Computes the first canonical code of each length and the number of
+ * codes of each length. Returns -1 if a length is too long or the
+ * lengths describe more codes than fit (an over-subscribed code).
+ */
+static int _canonical_codes(const uint8_t *lengths, uint32_t *first_code,
+                            uint16_t *count) {
+  memset(count, 0, (HUFFMAN_MAX_CODE_LENGTH + 1) * sizeof(uint16_t));
+
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    if (lengths[symbol] > HUFFMAN_MAX_CODE_LENGTH) {
+      return -1;
+    }
+    count[lengths[symbol]]++;
+  }
+  count[0] = 0;
+
+  uint64_t code = 0;
+  for (int length = 1; length <= HUFFMAN_MAX_CODE_LENGTH; length++) {
+    code = (code + count[length - 1]) << 1;
+    first_code[length] = code;
+
+    if (code + count[length] > (UINT64_C(1) << length)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Assigns canonical codes for the given code lengths to the table.
+ * Returns 0 on success and -1 if the lengths are not a valid prefix
+ * code of at most HUFFMAN_MAX_CODE_LENGTH bits.
+ */
+int huffman_table_init(huffman_table_t *table, const uint8_t *lengths) {
+  assert(table);
+  assert(lengths);
+
+  uint32_t next_code[HUFFMAN_MAX_CODE_LENGTH + 1];
+  uint16_t count[HUFFMAN_MAX_CODE_LENGTH + 1];
+
+  if (_canonical_codes(lengths, next_code, count) != 0) {
+    return -1;
+  }
+
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    const int length = lengths[symbol];
+    table->codes[symbol].length = length;
+    table->codes[symbol].code = length > 0 ? next_code[length]++ : 0;
+  }
+  return 0;
+}
+
+/*
+ * Returns the number of bytes huffman_encode will write for the n
+ * symbols in in.
+ */
+size_t huffman_encoded_size(const huffman_table_t *table, const uint8_t *in,
+                            size_t n) {
+  uint64_t bits = 0;
+  for (size_t i = 0; i < n; i++) {
+    bits += table->codes[in[i]].length;
+  }
+  return (bits + 7) / 8;
+}
+
+static void put_bits(bit_writer_t *w, uint32_t code, int length) {
+  w->buffer = w->buffer << length | code;
+  w->bits += length;
+
+  if (w->bits >= 32) {
+    w->bits -= 32;
+    const uint32_t word = (uint32_t) (w->buffer >> w->bits);
+    w->out[0] = word >> 24;
+    w->out[1] = word >> 16;
+    w->out[2] = word >> 8;
+    w->out[3] = word;
+    w->out += 4;
+  }
+}
+
+/*
+ * Writes out the pending bits, padding the last byte with zeros.
+ */
+static void flush_bits(bit_writer_t *w) {
+  while (w->bits > 0) {
+    const int shift = w->bits - 8;
+    *w->out++ = shift >= 0 ? w->buffer >> shift : w->buffer << -shift;
+    w->bits -= 8;
+  }
+  w->bits = 0;
+}
+
+/*
+ * Encodes the n symbols in in to out, which must have room for
+ * huffman_encoded_size bytes, and returns the number of bytes written.
+ *
+ * Pre: every symbol in in has a code in the table.
+ */
+size_t huffman_encode(const huffman_table_t *table, const uint8_t *in,
+                      size_t n, uint8_t *out) {
+  assert(table);
+  bit_writer_t w = {out, 0, 0};
+
+  for (size_t i = 0; i < n; i++) {
+    const huffman_code_t code = table->codes[in[i]];
+    assert(code.length > 0);
+    put_bits(&w, code.code, code.length);
+  }
+
+  flush_bits(&w);
+  return w.out - out;
+}
+
+/*
+ * Prepares a decoder for the canonical code with the given lengths.
+ * Returns 0 on success and -1 if the lengths are not a valid prefix code.
+ */
+int huffman_decoder_init(huffman_decoder_t *d, const uint8_t *lengths) {
+  assert(d);
+  assert(lengths);
+
+  if (_canonical_codes(lengths, d->first_code, d->count) != 0) {
+    return -1;
+  }
+
+  /* Symbols sorted by code length, then by value, as codes are assigned */
+  uint16_t index = 0;
+  d->max_length = 0;
+  for (int length = 1; length <= HUFFMAN_MAX_CODE_LENGTH; length++) {
+    d->first_index[length] = index;
+    for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+      if (lengths[symbol] == length) {
+        d->symbols[index++] = symbol;
+        d->max_length = length;
+      }
+    }
+  }
+
+  memset(d->lookup, 0, sizeof(d->lookup));
+  for (int length = 1; length <= HUFFMAN_LOOKUP_BITS; length++) {
+    for (int i = 0; i < d->count[length]; i++) {
+      const uint32_t code = d->first_code[length] + i;
+      const int spare = HUFFMAN_LOOKUP_BITS - length;
+      const uint16_t entry =
+          LOOKUP_ENTRY(d->symbols[d->first_index[length] + i], length);
+
+      for (uint32_t suffix = 0; suffix < (UINT32_C(1) << spare); suffix++) {
+        d->lookup[code << spare | suffix] = entry;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * Tops the reader up to at least 56 bits, eight bytes at a time while
+ * the input lasts. Past the end of the input zeros are shifted in and
+ * counted in padding.
+ */
+static void refill(bit_reader_t *r) {
+  if (r->end - r->in >= 8) {
+    refill_fast(r);
+    return;
+  }
+
+  while (r->bits <= 56) {
+    if (r->in < r->end) {
+      r->buffer |= (uint64_t) *r->in++ << (56 - r->bits);
+    } else {
+      r->padding += 8;
+    }
+    r->bits += 8;
+  }
+}
+
+/*
+ * Decodes the symbol whose code starts at the top bit of window and
+ * stores the length of its code in length. Returns the symbol, or -1 if
+ * no code starts the window.
+ */
+int huffman_decode_symbol(const huffman_decoder_t *d, uint64_t window,
+                          int *length) {
+  const uint16_t entry = d->lookup[window >> (64 - HUFFMAN_LOOKUP_BITS)];
+
+  if (LOOKUP_LENGTH(entry) > 0) {
+    *length = LOOKUP_LENGTH(entry);
+    return LOOKUP_SYMBOL(entry);
+  }
+
+  /* Longer codes: find the length whose code range contains the window */
+  for (int l = HUFFMAN_LOOKUP_BITS + 1; l <= d->max_length; l++) {
+    const uint32_t code = window >> (64 - l);
+    if (code >= d->first_code[l] && code - d->first_code[l] < d->count[l]) {
+      *length = l;
+      return d->symbols[d->first_index[l] + code - d->first_code[l]];
+    }
+  }
+  return -1;
+}
+
+/*
+ * Tops the reader up to at least 56 bits from the eight bytes at r->in.
+ *
+ * Pre: at least eight bytes of input are left.
+ */
+static inline void refill_fast(bit_reader_t *r) {
+  const uint8_t *p = r->in;
+  const uint64_t word = (uint64_t) p[0] << 56 | (uint64_t) p[1] << 48 |
+                        (uint64_t) p[2] << 40 | (uint64_t) p[3] << 32 |
+                        (uint64_t) p[4] << 24 | (uint64_t) p[5] << 16 |
+                        (uint64_t) p[6] << 8 | (uint64_t) p[7];
+  r->buffer |= word >> r->bits;
+  r->in += (63 - r->bits) >> 3;
+  r->bits |= 56;
+}
+
+/*
+ * Decodes the next symbol into out without refilling the reader. Returns
+ * 0 on success and -1 if no code matches.
+ *
+ * Pre: the reader holds at least max_length bits.
+ */
+static inline int decode_fast(const huffman_decoder_t *d, bit_reader_t *r,
+                              uint8_t *out) {
+  const uint16_t entry = d->lookup[r->buffer >> (64 - HUFFMAN_LOOKUP_BITS)];
+  int length = LOOKUP_LENGTH(entry);
+
+  if (length > 0) {
+    *out = LOOKUP_SYMBOL(entry);
+  } else {
+    const int symbol = huffman_decode_symbol(d, r->buffer, &length);
+    if (symbol < 0) {
+      return -1;
+    }
+    *out = symbol;
+  }
+
+  r->buffer <<= length;
+  r->bits -= length;
+  return 0;
+}
+
+/*
+ * Decodes the next symbol from the reader into out. Returns 0 on success
+ * and -1 if no code matches.
+ */
+static inline int decode_next(const huffman_decoder_t *d, bit_reader_t *r,
+                              uint8_t *out) {
+  if (r->bits < HUFFMAN_MAX_CODE_LENGTH) {
+    refill(r);
+  }
+
+  const uint16_t entry = d->lookup[r->buffer >> (64 - HUFFMAN_LOOKUP_BITS)];
+  int length = LOOKUP_LENGTH(entry);
+
+  if (length > 0) {
+    *out = LOOKUP_SYMBOL(entry);
+  } else {
+    const int symbol = huffman_decode_symbol(d, r->buffer, &length);
+    if (symbol < 0) {
+      return -1;
+    }
+    *out = symbol;
+  }
+
+  r->buffer <<= length;
+  r->bits -= length;
+  return 0;
+}
+
+/*
+ * Decoding must not have run into the padding past the input.
+ */
+static int reader_overrun(const bit_reader_t *r) {
+  return r->padding > (size_t) r->bits;
+}
+
+/*
+ * Decodes n symbols from the in_size bytes at in into out. Returns 0 on
+ * success and -1 if the input is not a valid encoding of n symbols.
+ */
+int huffman_decode(const huffman_decoder_t *d, const uint8_t *in,
+                   size_t in_size, uint8_t *out, size_t n) {
+  assert(d);
+  bit_reader_t r = {in, in + in_size, 0, 0, 0};
+
+  for (size_t i = 0; i < n; i++) {
+    if (decode_next(d, &r, out + i) != 0) {
+      return -1;
+    }
+  }
+  return reader_overrun(&r) ? -1 : 0;
+}
+
+/*
+ * Stores the bounds of the HUFFMAN_STREAMS segments that n symbols are
+ * split into. Segment i is [start[i], start[i + 1]), and no segment is
+ * longer than the one before it.
+ */
+static void split_streams(size_t n, size_t *start) {
+  const size_t quarter = (n + HUFFMAN_STREAMS - 1) / HUFFMAN_STREAMS;
+
+  for (int i = 0; i <= HUFFMAN_STREAMS; i++) {
+    start[i] = (size_t) i * quarter < n ? (size_t) i * quarter : n;
+  }
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+         (uint32_t) p[2] << 8 | p[3];
+}
+
+/*
+ * Returns the number of bytes huffman_encode4 will write for the n
+ * symbols in in.
+ */
+size_t huffman_encoded_size4(const huffman_table_t *table, const uint8_t *in,
+                             size_t n) {
+  size_t start[HUFFMAN_STREAMS + 1], size = HUFFMAN_JUMP_TABLE_SIZE;
+  split_streams(n, start);
+
+  for (int i = 0; i < HUFFMAN_STREAMS; i++) {
+    size += huffman_encoded_size(table, in + start[i], start[i + 1] - start[i]);
+  }
+  return size;
+}
+
+/*
+ * Encodes the n symbols in in as HUFFMAN_STREAMS separate bitstreams, one
+ * for each consecutive quarter of the symbols, so that they can be
+ * decoded in parallel. The streams follow a jump table holding the sizes
+ * of all but the last as 32-bit big-endian integers. out must have room
+ * for huffman_encoded_size4 bytes; returns the number of bytes written.
+ *
+ * Pre: every symbol in in has a code in the table, and each stream is
+ *      smaller than 4GB.
+ */
+size_t huffman_encode4(const huffman_table_t *table, const uint8_t *in,
+                       size_t n, uint8_t *out) {
+  size_t start[HUFFMAN_STREAMS + 1], size = HUFFMAN_JUMP_TABLE_SIZE;
+  split_streams(n, start);
+
+  for (int i = 0; i < HUFFMAN_STREAMS; i++) {
+    const size_t stream_size = huffman_encode(table, in + start[i],
+                                              start[i + 1] - start[i],
+                                              out + size);
+    if (i < HUFFMAN_STREAMS - 1) {
+      put_u32(out + 4 * i, stream_size);
+    }
+    size += stream_size;
+  }
+  return size;
+}
+
+/*
+ * Decodes n symbols written by huffman_encode4 from the in_size bytes at
+ * in into out. The four streams are advanced in lockstep, so their
+ * independent chains of table lookups overlap in the processor. Returns 0
+ * on success and -1 if the input is not a valid encoding of n symbols.
+ */
+int huffman_decode4(const huffman_decoder_t *d, const uint8_t *in,
+                    size_t in_size, uint8_t *out, size_t n) {
+  assert(d);
+  assert(HUFFMAN_STREAMS == 4);
+
+  if (in_size < HUFFMAN_JUMP_TABLE_SIZE) {
+    return -1;
+  }
+
+  /* Bounds of the streams in the input, checked against its size */
+  const uint8_t *bounds[HUFFMAN_STREAMS + 1];
+  bounds[0] = in + HUFFMAN_JUMP_TABLE_SIZE;
+  size_t remaining = in_size - HUFFMAN_JUMP_TABLE_SIZE;
+
+  for (int i = 0; i < HUFFMAN_STREAMS - 1; i++) {
+    const uint32_t stream_size = get_u32(in + 4 * i);
+    if (stream_size > remaining) {
+      return -1;
+    }
+    bounds[i + 1] = bounds[i] + stream_size;
+    remaining -= stream_size;
+  }
+  bounds[HUFFMAN_STREAMS] = in + in_size;
+
+  size_t start[HUFFMAN_STREAMS + 1];
+  split_streams(n, start);
+
+  bit_reader_t r0 = {bounds[0], bounds[1], 0, 0, 0};
+  bit_reader_t r1 = {bounds[1], bounds[2], 0, 0, 0};
+  bit_reader_t r2 = {bounds[2], bounds[3], 0, 0, 0};
+  bit_reader_t r3 = {bounds[3], bounds[4], 0, 0, 0};
+  uint8_t *o0 = out + start[0], *o1 = out + start[1];
+  uint8_t *o2 = out + start[2], *o3 = out + start[3];
+
+  /* The last segment is the shortest; the others have at most 3 more */
+  const size_t common = start[4] - start[3];
+  int status = 0;
+
+  /*
+   * While every stream has eight bytes left, refill each once per round
+   * without checking and decode as many symbols as 56 bits always hold.
+   */
+  const size_t per_refill = 56 / (d->max_length > 0 ? d->max_length : 1);
+  size_t i = 0;
+
+  /* Length-limited codes of up to 14 bits allow four symbols a refill */
+  const size_t step = per_refill >= 4 ? 4 : 2;
+
+  if (per_refill >= 2) {
+    for (; i + step <= common && r0.end - r0.in >= 8 &&
+           r1.end - r1.in >= 8 && r2.end - r2.in >= 8 && r3.end - r3.in >= 8;
+         i += step) {
+      refill_fast(&r0);
+      refill_fast(&r1);
+      refill_fast(&r2);
+      refill_fast(&r3);
+
+      for (size_t k = i; k < i + step; k++) {
+        status |= decode_fast(d, &r0, o0 + k);
+        status |= decode_fast(d, &r1, o1 + k);
+        status |= decode_fast(d, &r2, o2 + k);
+        status |= decode_fast(d, &r3, o3 + k);
+      }
+    }
+  }
+
+  for (; i < common; i++) {
+    status |= decode_next(d, &r0, o0 + i);
+    status |= decode_next(d, &r1, o1 + i);
+    status |= decode_next(d, &r2, o2 + i);
+    status |= decode_next(d, &r3, o3 + i);
+  }
+
+  for (size_t i = common; i < start[1] - start[0]; i++) {
+    status |= decode_next(d, &r0, o0 + i);
+  }
+  for (size_t i = common; i < start[2] - start[1]; i++) {
+    status |= decode_next(d, &r1, o1 + i);
+  }
+  for (size_t i = common; i < start[3] - start[2]; i++) {
+    status |= decode_next(d, &r2, o2 + i);
+  }
+
+  if (status != 0 || reader_overrun(&r0) || reader_overrun(&r1) ||
+      reader_overrun(&r2) || reader_overrun(&r3)) {
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Starts a model in which every symbol is equally likely. Codes are
+ * limited to max_length bits unless it is 0. Returns 0 on success and -1
+ * if max_length is too short for HUFFMAN_SYMBOLS symbols.
+ */
+int huffman_model_init(huffman_model_t *model, int max_length) {
+  assert(model);
+
+  for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+    model->counts[symbol] = 1;
+  }
+  model->total = HUFFMAN_SYMBOLS;
+  model->max_length = max_length;
+  return _huffman_model_rebuild(model);
+}
+
+/*
+ * Adds the n symbols at in to the model's counts and rebuilds its code.
+ * Returns 0 on success and -1 if the code cannot be built.
+ */
+int huffman_model_update(huffman_model_t *model, const uint8_t *in,
+                         size_t n) {
+  assert(model);
+
+  huffman_histogram(in, n, model->counts);
+  model->total += n;
+
+  /* Halving keeps every count at least 1 */
+  while (model->total > HUFFMAN_MODEL_LIMIT) {
+    model->total = 0;
+    for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+      model->counts[symbol] = (model->counts[symbol] + 1) / 2;
+      model->total += model->counts[symbol];
+    }
+  }
+  return _huffman_model_rebuild(model);
+}
+
+/*
+ * Private helper function for the model functions, building the table and
+ * decoder from the current counts. Their total of at most
+ * HUFFMAN_MODEL_LIMIT keeps unlimited codes far shorter than 32 bits.
+ */
+static int _huffman_model_rebuild(huffman_model_t *model) {
+  uint8_t lengths[HUFFMAN_SYMBOLS];
+  const int longest =
+      model->max_length > 0
+          ? huffman_limit_lengths(model->counts, model->max_length, lengths)
+          : huffman_build_lengths(model->counts, lengths);
+
+  if (longest < 0 || huffman_table_init(&model->table, lengths) != 0 ||
+      huffman_decoder_init(&model->decoder, lengths) != 0) {
+    return -1;
+  }
+  return 0;
+}
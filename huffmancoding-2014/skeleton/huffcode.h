@@ -0,0 +1,114 @@
+#ifndef __HUFFCODE_H
+#define __HUFFCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "exam.h"
+
+/*
+ * Canonical Huffman coding of byte strings.
+ *
+ * Only the code length of each symbol is taken from a Huffman tree, or
+ * computed directly from a histogram of the input. The
+ * codes themselves are assigned canonically: shorter codes first, and
+ * within a length in increasing symbol order. The lengths alone
+ * therefore describe the code. Codes are written most significant bit
+ * first through a 64-bit bit buffer. They are decoded with a lookup
+ * table indexed by the next HUFFMAN_LOOKUP_BITS bits of input, and
+ * longer codes fall back to a canonical search by length.
+ *
+ * The 4 variants split the input into HUFFMAN_STREAMS bitstreams that
+ * are decoded in lockstep, which is faster than one serial stream.
+ *
+ * A model instead derives the code from the symbols already coded, so a
+ * stream can be coded in one pass without sending any code lengths.
+ */
+
+enum { HUFFMAN_SYMBOLS = 256 };
+enum { HUFFMAN_MAX_CODE_LENGTH = 32 };
+enum { HUFFMAN_LOOKUP_BITS = 11 };
+enum { HUFFMAN_STREAMS = 4 };
+enum { HUFFMAN_JUMP_TABLE_SIZE = 4 * (HUFFMAN_STREAMS - 1) };
+
+enum { HUFFMAN_MODEL_LIMIT = 1 << 16 };
+
+enum { HUFFMAN_MAX_NODES = 2 * HUFFMAN_SYMBOLS - 1 };
+enum { HUFFMAN_NO_NODE = 0xffff };
+
+/*
+ * A Huffman tree held in one flat array, children referred to by index,
+ * so that it is built without allocation and discarded in O(1). Leaves
+ * have no children (HUFFMAN_NO_NODE).
+ */
+typedef struct huffman_node {
+  uint64_t count;
+  uint16_t left, right;
+  uint8_t symbol;
+} huffman_node_t;
+
+typedef struct huffman_arena {
+  huffman_node_t nodes[HUFFMAN_MAX_NODES];
+  uint16_t size, root;
+} huffman_arena_t;
+
+typedef struct huffman_code {
+  uint32_t code;
+  uint8_t length;
+} huffman_code_t;
+
+typedef struct huffman_table {
+  huffman_code_t codes[HUFFMAN_SYMBOLS];
+} huffman_table_t;
+
+typedef struct huffman_decoder {
+  uint16_t lookup[1 << HUFFMAN_LOOKUP_BITS];
+  uint32_t first_code[HUFFMAN_MAX_CODE_LENGTH + 1];
+  uint16_t first_index[HUFFMAN_MAX_CODE_LENGTH + 1];
+  uint16_t count[HUFFMAN_MAX_CODE_LENGTH + 1];
+  uint8_t symbols[HUFFMAN_SYMBOLS];
+  int max_length;
+} huffman_decoder_t;
+
+/*
+ * An adaptive code: the encoder and decoder of a stream each update their
+ * model with the same symbols, in the same order, and so rebuild the same
+ * code. Every count starts at 1, so that every symbol always has a code,
+ * and the counts are halved whenever their total passes
+ * HUFFMAN_MODEL_LIMIT, so that the code follows changes in the stream.
+ */
+typedef struct huffman_model {
+  uint64_t counts[HUFFMAN_SYMBOLS];
+  uint64_t total;
+  int max_length;
+  huffman_table_t table;
+  huffman_decoder_t decoder;
+} huffman_model_t;
+
+void huffman_histogram(const uint8_t *in, size_t n, uint64_t *counts);
+int huffman_arena_build(huffman_arena_t *, const uint64_t *counts);
+int huffman_arena_lengths(const huffman_arena_t *, uint8_t *lengths);
+int huffman_build_lengths(const uint64_t *counts, uint8_t *lengths);
+int huffman_limit_lengths(const uint64_t *counts, int max_length,
+                          uint8_t *lengths);
+void huffman_code_lengths(const huffman_tree_t *, uint8_t *lengths);
+int huffman_table_init(huffman_table_t *, const uint8_t *lengths);
+size_t huffman_encoded_size(const huffman_table_t *, const uint8_t *in,
+                            size_t n);
+size_t huffman_encode(const huffman_table_t *, const uint8_t *in, size_t n,
+                      uint8_t *out);
+size_t huffman_encoded_size4(const huffman_table_t *, const uint8_t *in,
+                             size_t n);
+size_t huffman_encode4(const huffman_table_t *, const uint8_t *in, size_t n,
+                       uint8_t *out);
+int huffman_decoder_init(huffman_decoder_t *, const uint8_t *lengths);
+int huffman_decode_symbol(const huffman_decoder_t *, uint64_t window,
+                          int *length);
+int huffman_decode(const huffman_decoder_t *, const uint8_t *in,
+                   size_t in_size, uint8_t *out, size_t n);
+int huffman_decode4(const huffman_decoder_t *, const uint8_t *in,
+                    size_t in_size, uint8_t *out, size_t n);
+int huffman_model_init(huffman_model_t *, int max_length);
+int huffman_model_update(huffman_model_t *, const uint8_t *in, size_t n);
+
+#endif
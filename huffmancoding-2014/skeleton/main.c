@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "exam.h"
+#include "huffcode.h"
 
 int main(int argc, char **argv) {
   char s[MAX_STRING_LENGTH];
@@ -39,6 +40,26 @@ int main(int argc, char **argv) {
   char *decoded = huffman_tree_decode(t, code);
   printf("\"%s\" decodes to \"%s\"\n", code, decoded);
 
+  uint8_t lengths[HUFFMAN_SYMBOLS];
+  huffman_table_t codes;
+  huffman_decoder_t decoder;
+  huffman_code_lengths(t, lengths);
+  huffman_table_init(&codes, lengths);
+  huffman_decoder_init(&decoder, lengths);
+
+  const size_t n = strlen(s);
+  uint8_t *packed = malloc(huffman_encoded_size(&codes, (uint8_t *) s, n) + 1);
+  char *unpacked = calloc(n + 1, sizeof(char));
+  assert(packed != NULL && unpacked != NULL);
+
+  const size_t size = huffman_encode(&codes, (uint8_t *) s, n, packed);
+  int status = huffman_decode(&decoder, packed, size, (uint8_t *) unpacked, n);
+  printf("\"%s\" packs into %zu bytes, which unpack to \"%s\"\n", s, size,
+         status == 0 ? unpacked : "(error)");
+
+  free(unpacked);
+  free(packed);
+
   free(decoded);
   free(code);
 